@@ -0,0 +1,440 @@
+/*
+File: nand_benchmark.c
+Description: Throughput benchmark of the NAND interface, a main of its own to build instead of my_main.c
+			.. named workloads: raw bus read/write (get_data/send_data), single page read/program,
+			.. .. sequential cache read, cache program, block erase and a mixed random read/write
+			.. .. and the page program, page read and block erase scripts of nand_script.h run by script_run()
+			.. .. .. the pages the script read are compared with the data programmed and with read_page()
+			.. each workload runs BENCHMARK_WARMUP untimed iterations, then BENCHMARK_ITERATIONS timed ones
+			.. .. every iteration is timed on its own with two snapshots of the free running timer (trace_now())
+			.. .. the cost of the pair is taken off, the timer is only started once so traces stay valid
+			.. results are one CSV line per workload, cycles per byte and MB/s at CPU_CLOCK_MHZ
+			.. the blocks BENCHMARK_FIRST_BLOCK to BENCHMARK_FIRST_BLOCK+BENCHMARK_BLOCKS-1 of LUN 0 are ERASED
+			.. .. and overwritten, pick blocks that are good and hold nothing
+			.. on a linux host build it with -DHOST_SIMULATION=true together with the .c files of nios (all but my_main.c)
+			.. .. it then runs on the device model of nand_simulator.c, the flash image is kept in the file
+			.. .. named by the environment variable NAND_IMAGE if it is set
+			.. with TIMING_CHECK the bus waveform of every workload is checked against the timing mode in use
+			.. .. the capture slows the bus down on the board, the numbers are then only good for the check
+*/
+
+#include "nand_interface_header.h"
+#include "nand_trace.h"
+#include "nand_script.h"
+#if HOST_SIMULATION
+#include "nand_simulator.h"
+#endif
+#if TIMING_CHECK
+#include "nand_timing_check.h"
+#endif
+
+#ifndef BENCHMARK_ITERATIONS
+	#define BENCHMARK_ITERATIONS 32
+#endif
+#ifndef BENCHMARK_WARMUP
+	#define BENCHMARK_WARMUP 4
+#endif
+#ifndef BENCHMARK_FIRST_BLOCK
+	#define BENCHMARK_FIRST_BLOCK 64
+#endif
+#ifndef BENCHMARK_BLOCKS
+	#define BENCHMARK_BLOCKS 8
+#endif
+// pages per iteration of the cache read and cache program workloads
+#ifndef BENCHMARK_CACHE_PAGES
+	#define BENCHMARK_CACHE_PAGES 16
+#endif
+// one write in BENCHMARK_WRITE_RATIO operations of the mixed workload
+#define BENCHMARK_WRITE_RATIO 4
+
+typedef struct
+{
+	const char* name;
+	void (*setup)();				// untimed, can be NULL
+	void (*step)(uint32_t iteration);
+	void (*teardown)();				// untimed, can be NULL
+	uint32_t pages;					// pages moved by one step (0 for the erase)
+}benchmark_workload;
+
+uint8_t* benchmark_buffer = NULL;	// BENCHMARK_CACHE_PAGES pages
+uint8_t** benchmark_pages = NULL;	// one pointer per page of benchmark_buffer
+uint32_t benchmark_overhead = 0;	// cycles of an empty pair of timer snapshots
+uint32_t benchmark_cursor = 0;		// next page to program, counted from the first page of the area
+uint32_t benchmark_random = 1;
+
+uint32_t benchmark_area_pages()
+{
+	return BENCHMARK_BLOCKS*device_geometry.pages_per_block;
+}
+
+// full address of page number index of the area
+void benchmark_address(uint32_t index, uint8_t* address)
+{
+	make_page_address(0,BENCHMARK_FIRST_BLOCK+index/device_geometry.pages_per_block,index%device_geometry.pages_per_block,0,address);
+}
+
+// xorshift, so every run does the same operations
+uint32_t benchmark_next_random()
+{
+	benchmark_random ^= benchmark_random<<13;
+	benchmark_random ^= benchmark_random>>17;
+	benchmark_random ^= benchmark_random<<5;
+	return benchmark_random;
+}
+
+void benchmark_erase_area()
+{
+	uint8_t row_address[MAX_ROW_ADDRESS_CYCLES];
+
+	for(uint32_t block=0;block<BENCHMARK_BLOCKS;block++)
+	{
+		make_row_address(0,BENCHMARK_FIRST_BLOCK+block,0,row_address);
+		erase_block(row_address);
+	}
+	benchmark_cursor = 0;
+}
+
+// program the next page of the area, erasing its block first when it is the first page
+// .. wraps around at the end of the area
+void benchmark_program_next(uint8_t* data)
+{
+	uint8_t address[MAX_ADDRESS_CYCLES];
+
+	benchmark_address(benchmark_cursor,address);
+	if(benchmark_cursor%device_geometry.pages_per_block==0)
+	{
+		erase_block(address+device_geometry.column_address_cycles);
+	}
+	program_page(address,data,device_geometry.page_size);
+	benchmark_cursor = (benchmark_cursor+1)%benchmark_area_pages();
+}
+
+// raw bus read: the page stays in the data register, only the column goes back to 0
+void bench_bus_read_setup()
+{
+	uint8_t address[MAX_ADDRESS_CYCLES];
+
+	benchmark_address(0,address);
+	read_page(address,full_address_cycles());
+}
+
+void bench_bus_read_step(uint32_t iteration)
+{
+	uint8_t column[MAX_COLUMN_ADDRESS_CYCLES] = {0};
+
+	(void)iteration;
+	change_read_column(column);
+	get_data(benchmark_buffer,device_geometry.page_size);
+}
+
+// raw bus write: data input to the cache register of a program that is never confirmed
+void bench_bus_write_setup()
+{
+	uint8_t address[MAX_ADDRESS_CYCLES];
+
+	benchmark_address(0,address);
+	cache_register_forget_all();
+	send_command(0x80);
+	send_addresses(address,full_address_cycles());
+	tADL;
+}
+
+void bench_bus_write_step(uint32_t iteration)
+{
+	uint8_t column[MAX_COLUMN_ADDRESS_CYCLES] = {0};
+
+	(void)iteration;
+	change_write_column(column);
+	send_data(benchmark_buffer,device_geometry.page_size);
+}
+
+void bench_bus_write_teardown()
+{
+	// drops the unconfirmed program
+	reset_device();
+}
+
+// single page read of a different page each time, so the data register never has it already
+void bench_page_read_step(uint32_t iteration)
+{
+	uint8_t address[MAX_ADDRESS_CYCLES];
+
+	benchmark_address(iteration%benchmark_area_pages(),address);
+	read_page(address,full_address_cycles());
+	get_data(benchmark_buffer,device_geometry.page_size);
+}
+
+void bench_page_program_step(uint32_t iteration)
+{
+	uint8_t address[MAX_ADDRESS_CYCLES];
+
+	benchmark_address(iteration,address);
+	program_page(address,benchmark_buffer,device_geometry.page_size);
+}
+
+void bench_cache_read_step(uint32_t iteration)
+{
+	uint8_t address[MAX_ADDRESS_CYCLES];
+	uint16_t page_len;
+	uint32_t first = (iteration*BENCHMARK_CACHE_PAGES)%benchmark_area_pages();
+
+	benchmark_address(first,address);
+	read_page_cache_sequential(address,full_address_cycles(),benchmark_buffer,&page_len,BENCHMARK_CACHE_PAGES);
+}
+
+void bench_cache_program_step(uint32_t iteration)
+{
+	uint8_t address[MAX_ADDRESS_CYCLES];
+
+	benchmark_address(iteration*BENCHMARK_CACHE_PAGES,address);
+	program_pages_cache(address+device_geometry.column_address_cycles,benchmark_pages,BENCHMARK_CACHE_PAGES,device_geometry.page_size,NULL);
+}
+
+void bench_block_erase_step(uint32_t iteration)
+{
+	uint8_t row_address[MAX_ROW_ADDRESS_CYCLES];
+
+	make_row_address(0,BENCHMARK_FIRST_BLOCK+iteration%BENCHMARK_BLOCKS,0,row_address);
+	erase_block(row_address);
+}
+
+// mixed random read/write, the erases needed by the writes are part of the time
+void bench_mixed_setup()
+{
+	benchmark_random = 1;
+	benchmark_erase_area();
+}
+
+void bench_mixed_step(uint32_t iteration)
+{
+	uint32_t random = benchmark_next_random();
+
+	(void)iteration;
+	if(random%BENCHMARK_WRITE_RATIO==0)
+	{
+		benchmark_program_next(benchmark_buffer);
+	}else
+	{
+		uint8_t address[MAX_ADDRESS_CYCLES];
+
+		benchmark_address((random/BENCHMARK_WRITE_RATIO)%benchmark_area_pages(),address);
+		read_page(address,full_address_cycles());
+		get_data(benchmark_buffer,device_geometry.page_size);
+	}
+}
+
+// the same operations as command scripts
+void bench_script_program_step(uint32_t iteration)
+{
+	uint8_t address[MAX_ADDRESS_CYCLES];
+	script_arg args[3];
+
+	benchmark_address(iteration,address);
+	args[0].pointer = address;
+	args[1].pointer = benchmark_buffer;
+	args[2].value = device_geometry.page_size;
+	if(script_run(script_program_page,args)&STATUS_FAIL)
+	{
+		printf("# script_page_program: page %lu failed\n",(unsigned long)iteration);
+	}
+}
+
+// .. the pages go to pages 1 and up of benchmark_buffer, page 0 is what bench_script_program_step wrote
+void bench_script_read_step(uint32_t iteration)
+{
+	uint8_t address[MAX_ADDRESS_CYCLES];
+	script_arg args[3];
+
+	benchmark_address(iteration,address);
+	args[0].pointer = address;
+	args[1].pointer = benchmark_pages[1+iteration%(BENCHMARK_CACHE_PAGES-1)];
+	args[2].value = device_geometry.page_size;
+	script_run(script_read_page,args);
+}
+
+void bench_script_read_teardown()
+{
+	uint8_t address[MAX_ADDRESS_CYCLES];
+	uint32_t mismatches = 0;
+
+	for(uint8_t i=1;i<BENCHMARK_CACHE_PAGES;i++)
+	{
+		if(memcmp(benchmark_pages[i],benchmark_pages[0],device_geometry.page_size))
+		{
+			mismatches++;
+		}
+	}
+	// .. and the last page again through the standard read
+	benchmark_address(BENCHMARK_WARMUP+BENCHMARK_ITERATIONS-1,address);
+	read_page(address,full_address_cycles());
+	get_data(benchmark_pages[1],device_geometry.page_size);
+	if(memcmp(benchmark_pages[1],benchmark_pages[0],device_geometry.page_size))
+	{
+		mismatches++;
+	}
+	if(mismatches)
+	{
+		printf("# script_page_read: %lu pages differ from the data programmed\n",(unsigned long)mismatches);
+	}
+}
+
+void bench_script_erase_step(uint32_t iteration)
+{
+	uint8_t row_address[MAX_ROW_ADDRESS_CYCLES];
+	script_arg args[1];
+
+	make_row_address(0,BENCHMARK_FIRST_BLOCK+iteration%BENCHMARK_BLOCKS,0,row_address);
+	args[0].pointer = row_address;
+	if(script_run(script_erase_block,args)&STATUS_FAIL)
+	{
+		printf("# script_block_erase: block %lu failed\n",(unsigned long)(BENCHMARK_FIRST_BLOCK+iteration%BENCHMARK_BLOCKS));
+	}
+}
+
+const benchmark_workload benchmark_workloads[] =
+{
+	{"bus_read",bench_bus_read_setup,bench_bus_read_step,NULL,1},
+	{"bus_write",bench_bus_write_setup,bench_bus_write_step,bench_bus_write_teardown,1},
+	{"page_read",NULL,bench_page_read_step,NULL,1},
+	{"page_program",benchmark_erase_area,bench_page_program_step,NULL,1},
+	{"cache_read",NULL,bench_cache_read_step,NULL,BENCHMARK_CACHE_PAGES},
+	{"cache_program",benchmark_erase_area,bench_cache_program_step,NULL,BENCHMARK_CACHE_PAGES},
+	{"block_erase",NULL,bench_block_erase_step,NULL,0},
+	{"mixed_random",bench_mixed_setup,bench_mixed_step,NULL,1},
+	{"script_page_program",benchmark_erase_area,bench_script_program_step,NULL,1},
+	{"script_page_read",NULL,bench_script_read_step,bench_script_read_teardown,1},
+	{"script_block_erase",NULL,bench_script_erase_step,NULL,0},
+};
+
+// prints value/100 with two decimals
+void benchmark_print_hundredths(uint64_t value)
+{
+	printf("%lu.%02lu",(unsigned long)(value/100),(unsigned long)(value%100));
+}
+
+void benchmark_run(const benchmark_workload* workload)
+{
+	uint32_t bytes = workload->pages*device_geometry.page_size;
+	uint64_t total = 0;
+	uint32_t min = 0xffffffff;
+	uint32_t max = 0;
+
+#if TIMING_CHECK
+	timing_check_mark(workload->name);
+#endif
+	if(workload->setup)
+	{
+		workload->setup();
+	}
+	for(uint32_t i=0;i<BENCHMARK_WARMUP;i++)
+	{
+		workload->step(i);
+	}
+	for(uint32_t i=BENCHMARK_WARMUP;i<BENCHMARK_WARMUP+BENCHMARK_ITERATIONS;i++)
+	{
+		uint32_t start = trace_now();
+		workload->step(i);
+		// the timer counts down
+		uint32_t cycles = start-trace_now();
+		cycles = (cycles>benchmark_overhead)?cycles-benchmark_overhead:0;
+
+		total += cycles;
+		if(cycles<min)
+		{
+			min = cycles;
+		}
+		if(cycles>max)
+		{
+			max = cycles;
+		}
+	}
+	if(workload->teardown)
+	{
+		workload->teardown();
+	}
+
+	printf("%s,%lu,%lu,%lu,%lu,%lu,",workload->name,(unsigned long)BENCHMARK_ITERATIONS,(unsigned long)bytes,
+		(unsigned long)(total/BENCHMARK_ITERATIONS),(unsigned long)min,(unsigned long)max);
+	if(bytes && total)
+	{
+		uint64_t total_bytes = (uint64_t)bytes*BENCHMARK_ITERATIONS;
+		// cycles per byte and bytes per microsecond (MB/s), both in hundredths
+		benchmark_print_hundredths(total*100/total_bytes);
+		printf(",");
+		benchmark_print_hundredths(total_bytes*CPU_CLOCK_MHZ*100/total);
+	}else
+	{
+		printf(",");
+	}
+	printf("\n");
+}
+
+int main()
+{
+#if HOST_SIMULATION
+	nand_simulator_config config = simulator_default_config;
+	config.backing_file = getenv("NAND_IMAGE");
+	if(!nand_simulator_open(&config))
+	{
+		return 1;
+	}
+#endif
+	device_initialization();
+
+	// the page workloads need at least this many pages in the area
+	if(benchmark_area_pages()<(BENCHMARK_WARMUP+BENCHMARK_ITERATIONS)*BENCHMARK_CACHE_PAGES)
+	{
+		printf("Benchmark area too small, raise BENCHMARK_BLOCKS\n");
+		return 1;
+	}
+
+	benchmark_buffer = (uint8_t*)malloc(BENCHMARK_CACHE_PAGES*device_geometry.page_size);
+	benchmark_pages = (uint8_t**)malloc(BENCHMARK_CACHE_PAGES*sizeof(uint8_t*));
+	if(!benchmark_buffer || !benchmark_pages)
+	{
+		printf("Not enough memory for the benchmark buffers\n");
+		return 1;
+	}
+	for(uint32_t i=0;i<BENCHMARK_CACHE_PAGES*device_geometry.page_size;i++)
+	{
+		benchmark_buffer[i] = i*131+7;
+	}
+	for(uint8_t i=0;i<BENCHMARK_CACHE_PAGES;i++)
+	{
+		benchmark_pages[i] = benchmark_buffer+i*device_geometry.page_size;
+	}
+
+#if TIMING_CHECK
+	// starts the timer too
+	timing_check_start(nand_timing.mode);
+#else
+	timer_start();
+#endif
+	benchmark_overhead = 0xffffffff;
+	for(uint8_t i=0;i<8;i++)
+	{
+		uint32_t start = trace_now();
+		uint32_t cycles = start-trace_now();
+		if(cycles<benchmark_overhead)
+		{
+			benchmark_overhead = cycles;
+		}
+	}
+
+	enable_erase();
+	printf("# %s %s, page %d bytes, %d MHz, timer overhead %lu cc\n",device_geometry.manufacturer,device_geometry.model,
+		device_geometry.page_size,CPU_CLOCK_MHZ,(unsigned long)benchmark_overhead);
+	printf("workload,iterations,bytes,mean_cycles,min_cycles,max_cycles,cycles_per_byte,mb_per_s\n");
+	for(uint8_t i=0;i<sizeof(benchmark_workloads)/sizeof(benchmark_workloads[0]);i++)
+	{
+		benchmark_run(&benchmark_workloads[i]);
+	}
+	disable_erase();
+#if TIMING_CHECK
+	timing_check_report();
+#endif
+
+	free(benchmark_pages);
+	free(benchmark_buffer);
+	return 0;
+}
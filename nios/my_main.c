@@ -74,11 +74,14 @@ int main()
 	erase_block(my_page_address+2);
 	disable_erase();
 
-	// // now read the erased page, should be 0xffs
-	read_page(my_page_address,5);
-	change_read_column(new_col);
-	get_data(data_received,100);
-	print_array(data_received,100);
+	// // now check the erased page, page and spare should be 0xffs
+	if(blank_check_page(my_page_address,BLANK_BITFLIP_THRESHOLD,NULL))
+	{
+		printf("Page is erased\n");
+	}else
+	{
+		printf("Page is not erased\n");
+	}
 
 	// // let us erase the block
 	// printf(" 3* Erasing address (address in reverse order:)");
@@ -0,0 +1,258 @@
+#include "nand_bad_block.h"
+#include "nand_ecc.h"
+
+uint8_t bbt_bitmap[BBT_MAX_BLOCKS/8];
+uint32_t bbt_version = 0;
+uint8_t bbt_copy = BBT_RESERVED_BLOCKS;
+bool bbt_dirty = false;
+
+// saved table: magic, version, number of blocks (4 bytes each), bitmap, CRC-16 of everything before it
+// .. at the start of page 0 of a reserved block, the page is written with its BCH parity
+#define BBT_HEADER_SIZE 12
+
+uint32_t bbt_total_blocks()
+{
+	return device_geometry.num_luns*device_geometry.blocks_per_lun;
+}
+
+uint32_t bbt_block_of(uint8_t* row_address)
+{
+	uint8_t lun;
+	uint32_t block;
+
+	split_row_address(row_address,&lun,&block,NULL);
+	return lun*device_geometry.blocks_per_lun+block;
+}
+
+void bbt_row_of(uint32_t block, uint8_t* row_address)
+{
+	make_row_address(block/device_geometry.blocks_per_lun,block%device_geometry.blocks_per_lun,0,row_address);
+}
+
+uint32_t bbt_next_good_block(uint32_t block)
+{
+	uint32_t usable = bbt_usable_blocks();
+
+	while(block<usable && bbt_is_bad(block))
+	{
+		block++;
+	}
+	return block;
+}
+
+void bbt_mark_bad(uint32_t block)
+{
+	if(!bbt_is_bad(block))
+	{
+		bbt_bitmap[block>>3] |= 1<<(block&7);
+		bbt_dirty = true;
+	}
+}
+
+// failure hook, runs inside the driver's completion so it only marks the block
+void bbt_failure_hook(uint8_t type, uint8_t* row_address, uint8_t status)
+{
+	(void)type;
+	(void)status;
+	uint32_t block = bbt_block_of(row_address);
+	printf("Block %lu marked bad\n",(unsigned long)block);
+	bbt_mark_bad(block);
+}
+
+// first spare byte of a page
+uint8_t bbt_read_marker(uint32_t block, uint32_t page)
+{
+	uint8_t address[MAX_ADDRESS_CYCLES];
+	uint8_t marker;
+
+	make_page_address(block/device_geometry.blocks_per_lun,block%device_geometry.blocks_per_lun,page,BBT_FACTORY_MARKER_COLUMN,address);
+	read_page(address,full_address_cycles());
+	get_data_while_busy(&marker,1);
+	return marker;
+}
+
+void bbt_scan_factory()
+{
+	uint32_t total = bbt_total_blocks();
+	uint32_t num_bad = 0;
+
+	memset(bbt_bitmap,0,sizeof(bbt_bitmap));
+	for(uint32_t block=0;block<total;block++)
+	{
+		if(bbt_read_marker(block,0)!=0xff || bbt_read_marker(block,device_geometry.pages_per_block-1)!=0xff)
+		{
+			bbt_bitmap[block>>3] |= 1<<(block&7);
+			num_bad++;
+		}
+	}
+	bbt_dirty = true;
+	printf("Factory scan: %lu bad blocks out of %lu\n",(unsigned long)num_bad,(unsigned long)total);
+}
+
+bool bbt_load()
+{
+	uint32_t total = bbt_total_blocks();
+	uint16_t bitmap_size = (total+7)/8;
+	uint8_t* image = (uint8_t*)malloc(device_geometry.page_size);
+	bool found = false;
+
+	if(image==NULL || total>BBT_MAX_BLOCKS)
+	{
+		free(image);
+		return false;
+	}
+	for(uint8_t copy=0;copy<BBT_RESERVED_BLOCKS;copy++)
+	{
+		uint8_t address[MAX_ADDRESS_CYCLES];
+		uint32_t block = bbt_usable_blocks()+copy;
+		uint32_t magic,version,num_blocks;
+		uint16_t crc;
+
+		make_page_address(block/device_geometry.blocks_per_lun,block%device_geometry.blocks_per_lun,0,0,address);
+		int16_t corrected = read_page_ecc(address,image,NULL);
+		if(corrected==ECC_ERASED)
+		{
+			continue;
+		}
+		if(corrected==ECC_UNCORRECTABLE)
+		{
+			printf("Bad block table copy %d is uncorrectable\n",copy);
+			continue;
+		}
+
+		memcpy(&magic,image,4);
+		memcpy(&version,image+4,4);
+		memcpy(&num_blocks,image+8,4);
+		memcpy(&crc,image+BBT_HEADER_SIZE+bitmap_size,2);
+		if(magic!=BBT_MAGIC || num_blocks!=total || crc!=onfi_crc16(image,BBT_HEADER_SIZE+bitmap_size))
+		{
+			printf("Bad block table copy %d is not valid\n",copy);
+			continue;
+		}
+		if(!found || version>bbt_version)
+		{
+			memset(bbt_bitmap,0,sizeof(bbt_bitmap));
+			memcpy(bbt_bitmap,image+BBT_HEADER_SIZE,bitmap_size);
+			bbt_version = version;
+			bbt_copy = copy;
+			found = true;
+		}
+	}
+	free(image);
+	if(!found)
+	{
+		bbt_copy = BBT_RESERVED_BLOCKS;
+	}
+	bbt_dirty = !found;
+	return found;
+}
+
+bool bbt_save()
+{
+	uint32_t total = bbt_total_blocks();
+	uint16_t bitmap_size = (total+7)/8;
+	uint8_t* image = (uint8_t*)malloc(device_geometry.page_size);
+	bool saved = false;
+
+	if(image==NULL)
+	{
+		return false;
+	}
+	// the rest of the page is zeroed, a page of mostly 0xff would be taken as erased by read_page_ecc()
+	memset(image,0,device_geometry.page_size);
+
+	// the table needs WP high, put it back the way it was afterwards
+	bool was_protected = !(port_shadow&WP_mask);
+	if(was_protected)
+	{
+		write_enable();
+	}
+
+	// the reserved blocks after the current copy in turn, the current copy itself is never erased
+	// .. a failing one is marked bad by the failure hook, so the next image has it
+	for(uint8_t step=1;step<=BBT_RESERVED_BLOCKS && !saved;step++)
+	{
+		uint8_t copy = (bbt_copy+step)%BBT_RESERVED_BLOCKS;
+		uint32_t version = bbt_version+1;
+		uint32_t block = bbt_usable_blocks()+copy;
+		uint8_t address[MAX_ADDRESS_CYCLES];
+		uint16_t crc;
+
+		if(copy==bbt_copy || bbt_is_bad(block))
+		{
+			continue;
+		}
+
+		memcpy(image,&(uint32_t){BBT_MAGIC},4);
+		memcpy(image+4,&version,4);
+		memcpy(image+8,&total,4);
+		memcpy(image+BBT_HEADER_SIZE,bbt_bitmap,bitmap_size);
+		crc = onfi_crc16(image,BBT_HEADER_SIZE+bitmap_size);
+		memcpy(image+BBT_HEADER_SIZE+bitmap_size,&crc,2);
+
+		make_page_address(block/device_geometry.blocks_per_lun,block%device_geometry.blocks_per_lun,0,0,address);
+		if(nand_wait(nand_submit_erase(address+device_geometry.column_address_cycles))&STATUS_FAIL)
+		{
+			continue;
+		}
+		if(program_page_ecc(address,image,NULL)&STATUS_FAIL)
+		{
+			continue;
+		}
+		bbt_version = version;
+		bbt_copy = copy;
+		saved = true;
+	}
+
+	if(was_protected)
+	{
+		write_protect();
+	}
+	free(image);
+	if(saved)
+	{
+		bbt_dirty = false;
+	}else
+	{
+		printf("Could not save the bad block table\n");
+	}
+	return saved;
+}
+
+bool bbt_flush()
+{
+	if(!bbt_dirty)
+	{
+		return true;
+	}
+	return bbt_save();
+}
+
+bool bbt_init()
+{
+	if(bbt_total_blocks()>BBT_MAX_BLOCKS)
+	{
+		printf("%lu blocks do not fit in the bad block table\n",(unsigned long)bbt_total_blocks());
+		return false;
+	}
+	nand_set_failure_hook(bbt_failure_hook);
+	if(bbt_load())
+	{
+		return true;
+	}
+	// a rescan on a device in use would forget the blocks marked bad at run time
+	printf("No valid bad block table, bbt_rebuild() has to be called to scan the factory markers\n");
+	return false;
+}
+
+bool bbt_rebuild()
+{
+	if(bbt_total_blocks()>BBT_MAX_BLOCKS)
+	{
+		printf("%lu blocks do not fit in the bad block table\n",(unsigned long)bbt_total_blocks());
+		return false;
+	}
+	nand_set_failure_hook(bbt_failure_hook);
+	bbt_scan_factory();
+	return bbt_save();
+}
@@ -0,0 +1,86 @@
+/*
+File: nand_bad_block.h
+Description: Bad block table
+			.. one bit per block (1 = bad), for all the blocks of all the LUNs
+			.. .. block numbers here are lun*blocks_per_lun + block
+			.. built once from the factory markers, then kept in the last BBT_RESERVED_BLOCKS blocks
+			.. .. each save goes to the next good reserved block after the one with the current copy (never to that one)
+			.. .. with the next version, so one copy is always whole
+			.. .. a reserved block that is bad (factory marker or failed save) is skipped
+			.. .. the table is written with program_page_ecc(), so ecc_init() is needed first
+			.. program and erase failures mark their block through the failure hook of the driver
+			.. Each of the functions declared here are defined in file nand_bad_block.c
+*/
+#ifndef nand_bad_block_h
+#define nand_bad_block_h
+
+#include "nand_interface_header.h"
+
+#define BBT_MAX_BLOCKS 16384
+#define BBT_RESERVED_BLOCKS 4
+
+// "BBT1" at the start of a saved table
+#define BBT_MAGIC 0x31544242
+
+// the factory marks a bad block with a non 0xff first spare byte on its first or last page
+#define BBT_FACTORY_MARKER_COLUMN (device_geometry.page_size)
+
+extern uint8_t bbt_bitmap[BBT_MAX_BLOCKS/8];
+extern uint32_t bbt_version;
+// reserved block (0 to BBT_RESERVED_BLOCKS-1) with the current copy, BBT_RESERVED_BLOCKS if none
+extern uint8_t bbt_copy;
+// true when the table in memory has changes not saved yet
+extern bool bbt_dirty;
+
+FORCE_INLINE inline bool bbt_is_bad(uint32_t block)
+{
+	return (bbt_bitmap[block>>3]>>(block&7))&1;
+}
+
+// number of blocks of the device
+uint32_t bbt_total_blocks();
+
+// number of blocks for the user, the reserved ones are at the end
+FORCE_INLINE inline uint32_t bbt_usable_blocks()
+{
+	return bbt_total_blocks()-BBT_RESERVED_BLOCKS;
+}
+
+// block number of a row address
+uint32_t bbt_block_of(uint8_t* row_address);
+
+// row address of page 0 of a block
+void bbt_row_of(uint32_t block, uint8_t* row_address);
+
+// first good block at or after block, bbt_usable_blocks() if none
+uint32_t bbt_next_good_block(uint32_t block);
+
+// function to mark a block bad in memory, bbt_flush() writes it out
+void bbt_mark_bad(uint32_t block);
+
+// function to build the table from the factory markers
+// .. reads one byte of the first and last page of each block, only valid on a device not written yet
+void bbt_scan_factory();
+
+// function to read the newest valid table from the reserved blocks
+// .. returns false if neither copy decodes and has the right magic, size and CRC
+bool bbt_load();
+
+// function to write the table with the next version to a reserved block other than bbt_copy
+// .. returns false if none of them could take it, the current copy is left as it is
+bool bbt_save();
+
+// saves the table if it has changed
+bool bbt_flush();
+
+// function to get the table at start-up
+// .. also registers the failure hook
+// .. returns false if there is no valid table, the factory markers are not scanned again here
+bool bbt_init();
+
+// function to build the table from the factory markers and save it
+// .. for the first start of a new device, or when the caller accepts losing the blocks marked bad since
+// .. also registers the failure hook
+bool bbt_rebuild();
+
+#endif
@@ -0,0 +1,414 @@
+#include "nand_ecc.h"
+
+// primitive polynomial of GF(2^14): x^14 + x^5 + x^3 + x + 1
+#define ECC_PRIMITIVE_POLYNOMIAL 0x402b
+
+// log and antilog tables of the field
+// .. gf_exp is twice as long so the sum of two logs needs no modulo
+uint16_t gf_exp[2*ECC_N];
+uint16_t gf_log[ECC_N+1];
+
+// generator polynomial without its leading term, left aligned as the parity register
+// .. bit 31 of word 0 is the coefficient of x^(ECC_PARITY_BITS-1)
+uint32_t bch_generator[ECC_PARITY_WORDS];
+
+// remainder of (byte value)*x^ECC_PARITY_BITS divided by the generator, same alignment as above
+uint32_t bch_encode_table[256][ECC_PARITY_WORDS];
+
+// value of a byte of the remainder at alpha^j for each odd j
+// .. bit i of the byte is the coefficient of x^i
+uint16_t bch_syndrome_table[ECC_T][256];
+
+// page and spare buffer used by program_page_ecc, spare buffer used by read_page_ecc
+uint8_t* ecc_page_buffer = NULL;
+
+FORCE_INLINE inline uint16_t gf_mul(uint16_t a, uint16_t b)
+{
+	if(a==0 || b==0)
+	{
+		return 0;
+	}
+	return gf_exp[gf_log[a]+gf_log[b]];
+}
+
+FORCE_INLINE inline uint16_t gf_div(uint16_t a, uint16_t b)
+{
+	if(a==0)
+	{
+		return 0;
+	}
+	return gf_exp[gf_log[a]+ECC_N-gf_log[b]];
+}
+
+// alpha^power, power can be any non negative value
+FORCE_INLINE inline uint16_t gf_pow(uint32_t power)
+{
+	return gf_exp[power%ECC_N];
+}
+
+// multiplies a polynomial (coefficients in the field, lowest first) by (x + root)
+void gf_poly_mul_root(uint16_t* poly, uint16_t* degree, uint16_t root)
+{
+	poly[*degree+1] = poly[*degree];
+	for(uint16_t i=*degree;i>0;i--)
+	{
+		poly[i] = poly[i-1]^gf_mul(poly[i],root);
+	}
+	poly[0] = gf_mul(poly[0],root);
+	(*degree)++;
+}
+
+// shift of the parity register by one bit, feeding bit
+void bch_register_step(uint32_t* reg, uint8_t bit)
+{
+	uint8_t feedback = (reg[0]>>31)^bit;
+	for(uint8_t i=0;i<ECC_PARITY_WORDS-1;i++)
+	{
+		reg[i] = (reg[i]<<1)|(reg[i+1]>>31);
+	}
+	reg[ECC_PARITY_WORDS-1] <<= 1;
+	if(feedback)
+	{
+		for(uint8_t i=0;i<ECC_PARITY_WORDS;i++)
+		{
+			reg[i] ^= bch_generator[i];
+		}
+	}
+}
+
+bool ecc_init()
+{
+	// field tables
+	uint32_t value = 1;
+	for(uint16_t i=0;i<ECC_N;i++)
+	{
+		gf_exp[i] = value;
+		gf_exp[i+ECC_N] = value;
+		gf_log[value] = i;
+		value <<= 1;
+		if(value&(1<<ECC_M))
+		{
+			value ^= ECC_PRIMITIVE_POLYNOMIAL;
+		}
+	}
+	gf_log[0] = 0;
+
+	// generator: product of (x + alpha^i) over the cyclotomic cosets of 1,3,..,2t-1
+	// .. the product has binary coefficients
+	static uint16_t generator[ECC_PARITY_BITS+1];
+	static uint8_t root_used[(ECC_N+7)/8];
+	uint16_t degree = 0;
+	memset(root_used,0,sizeof(root_used));
+	generator[0] = 1;
+	for(uint16_t j=1;j<2*ECC_T;j+=2)
+	{
+		uint32_t root = j;
+		while(!(root_used[root>>3]&(1<<(root&7))))
+		{
+			root_used[root>>3] |= 1<<(root&7);
+			if(degree==ECC_PARITY_BITS)
+			{
+				printf("ECC generator longer than %d bits\n",ECC_PARITY_BITS);
+				return false;
+			}
+			gf_poly_mul_root(generator,&degree,gf_exp[root]);
+			root = (root*2)%ECC_N;
+		}
+	}
+	if(degree!=ECC_PARITY_BITS)
+	{
+		printf("ECC generator has %d bits, expected %d\n",degree,ECC_PARITY_BITS);
+		return false;
+	}
+	memset(bch_generator,0,sizeof(bch_generator));
+	for(uint16_t i=0;i<ECC_PARITY_BITS;i++)
+	{
+		if(generator[i])
+		{
+			uint16_t position = ECC_PARITY_BITS-1-i;
+			bch_generator[position/32] |= 0x80000000u>>(position%32);
+		}
+	}
+
+	// byte-wise encoder table
+	for(uint16_t byte=0;byte<256;byte++)
+	{
+		memset(bch_encode_table[byte],0,sizeof(bch_encode_table[byte]));
+		for(int8_t bit=7;bit>=0;bit--)
+		{
+			bch_register_step(bch_encode_table[byte],(byte>>bit)&1);
+		}
+	}
+
+	// syndrome byte tables
+	for(uint8_t k=0;k<ECC_T;k++)
+	{
+		uint32_t j = 2*k+1;
+		for(uint16_t byte=0;byte<256;byte++)
+		{
+			uint16_t sum = 0;
+			for(uint8_t i=0;i<8;i++)
+			{
+				if(byte&(1<<i))
+				{
+					sum ^= gf_pow(j*i);
+				}
+			}
+			bch_syndrome_table[k][byte] = sum;
+		}
+	}
+
+	// page layout
+	uint16_t spare_needed = ECC_SPARE_PARITY_OFFSET+ecc_codewords_per_page()*ECC_PARITY_BYTES;
+	if(device_geometry.page_size%ECC_CODEWORD_SIZE || spare_needed>device_geometry.spare_size)
+	{
+		printf("ECC layout needs %d spare bytes, the device has %d\n",spare_needed,device_geometry.spare_size);
+		return false;
+	}
+	free(ecc_page_buffer);
+	ecc_page_buffer = (uint8_t*)malloc(device_geometry.page_size+device_geometry.spare_size);
+	return ecc_page_buffer!=NULL;
+}
+
+uint8_t ecc_codewords_per_page()
+{
+	return device_geometry.page_size/ECC_CODEWORD_SIZE;
+}
+
+// remainder of data*x^ECC_PARITY_BITS divided by the generator
+void bch_remainder(uint8_t* data, uint16_t len, uint32_t* reg)
+{
+	memset(reg,0,ECC_PARITY_WORDS*sizeof(uint32_t));
+	for(uint16_t i=0;i<len;i++)
+	{
+		uint32_t* row = bch_encode_table[(reg[0]>>24)^data[i]];
+		for(uint8_t w=0;w<ECC_PARITY_WORDS-1;w++)
+		{
+			reg[w] = ((reg[w]<<8)|(reg[w+1]>>24))^row[w];
+		}
+		reg[ECC_PARITY_WORDS-1] = (reg[ECC_PARITY_WORDS-1]<<8)^row[ECC_PARITY_WORDS-1];
+	}
+}
+
+void bch_encode(uint8_t* data, uint16_t len, uint8_t* parity)
+{
+	uint32_t reg[ECC_PARITY_WORDS];
+
+	bch_remainder(data,len,reg);
+	for(uint8_t i=0;i<ECC_PARITY_BYTES;i++)
+	{
+		parity[i] = reg[i/4]>>(24-8*(i%4));
+	}
+}
+
+int16_t bch_decode(uint8_t* data, uint16_t len, uint8_t* parity)
+{
+	uint32_t reg[ECC_PARITY_WORDS];
+	uint8_t error_bytes[ECC_PARITY_BYTES];
+	uint8_t any_error = 0;
+
+	// remainder of the received codeword = received parity xor parity of the received data
+	// .. a zero remainder means no errors, which is the usual case
+	bch_remainder(data,len,reg);
+	for(uint8_t i=0;i<ECC_PARITY_BYTES;i++)
+	{
+		error_bytes[i] = parity[i]^(uint8_t)(reg[i/4]>>(24-8*(i%4)));
+		any_error |= error_bytes[i];
+	}
+	if(!any_error)
+	{
+		return 0;
+	}
+
+	// syndromes S1..S2t from the remainder, one byte at a time
+	// .. byte i of the remainder holds x^(8*(ECC_PARITY_BYTES-1-i)+7) .. x^(8*(ECC_PARITY_BYTES-1-i))
+	uint16_t syndromes[2*ECC_T+1];
+	for(uint8_t k=0;k<ECC_T;k++)
+	{
+		uint32_t j = 2*k+1;
+		uint16_t step = gf_pow(8*j);
+		uint16_t sum = 0;
+		for(uint8_t i=0;i<ECC_PARITY_BYTES;i++)
+		{
+			sum = gf_mul(sum,step)^bch_syndrome_table[k][error_bytes[i]];
+		}
+		syndromes[j] = sum;
+	}
+	for(uint8_t j=2;j<=2*ECC_T;j+=2)
+	{
+		syndromes[j] = gf_mul(syndromes[j/2],syndromes[j/2]);
+	}
+
+	// Berlekamp-Massey for the error locator
+	uint16_t locator[ECC_T+2] = {1};
+	uint16_t previous[ECC_T+2] = {1};
+	uint16_t temporary[ECC_T+2];
+	uint8_t num_errors = 0;
+	uint8_t shift = 1;
+	uint16_t previous_discrepancy = 1;
+	for(uint8_t n=0;n<2*ECC_T;n++)
+	{
+		uint16_t discrepancy = syndromes[n+1];
+		for(uint8_t i=1;i<=num_errors;i++)
+		{
+			discrepancy ^= gf_mul(locator[i],syndromes[n+1-i]);
+		}
+		if(discrepancy==0)
+		{
+			shift++;
+			continue;
+		}
+		uint16_t factor = gf_div(discrepancy,previous_discrepancy);
+		bool grow = 2*num_errors<=n;
+		if(grow)
+		{
+			memcpy(temporary,locator,sizeof(locator));
+		}
+		for(uint8_t i=0;i+shift<=ECC_T+1;i++)
+		{
+			locator[i+shift] ^= gf_mul(factor,previous[i]);
+		}
+		if(grow)
+		{
+			num_errors = n+1-num_errors;
+			if(num_errors>ECC_T)
+			{
+				return ECC_UNCORRECTABLE;
+			}
+			memcpy(previous,temporary,sizeof(previous));
+			previous_discrepancy = discrepancy;
+			shift = 1;
+		}else
+		{
+			shift++;
+		}
+	}
+
+	// Chien search over the bit positions of the shortened code
+	// .. position e is the coefficient of x^e, x^0 is the last parity bit
+	// .. a root alpha^-e of the locator means bit e is in error
+	uint32_t num_bits = 8*((uint32_t)len+ECC_PARITY_BYTES);
+	uint16_t found = 0;
+	uint32_t term_log[ECC_T+1];
+	uint8_t num_terms = 0;
+	uint8_t term_power[ECC_T+1];
+	for(uint8_t i=1;i<=num_errors;i++)
+	{
+		if(locator[i])
+		{
+			term_log[num_terms] = gf_log[locator[i]];
+			term_power[num_terms] = i;
+			num_terms++;
+		}
+	}
+	for(uint32_t e=0;e<num_bits && found<num_errors;e++)
+	{
+		uint16_t sum = 1;
+		for(uint8_t i=0;i<num_terms;i++)
+		{
+			sum ^= gf_exp[term_log[i]];
+			// next position multiplies term i by alpha^-i
+			term_log[i] += ECC_N-term_power[i];
+			if(term_log[i]>=ECC_N)
+			{
+				term_log[i] -= ECC_N;
+			}
+		}
+		if(sum==0)
+		{
+			uint32_t bit = num_bits-1-e;
+			uint8_t mask = 0x80>>(bit%8);
+			if(bit/8<len)
+			{
+				data[bit/8] ^= mask;
+			}else
+			{
+				parity[bit/8-len] ^= mask;
+			}
+			found++;
+		}
+	}
+	// fewer roots inside the codeword than the degree of the locator: too many errors
+	if(found!=num_errors)
+	{
+		return ECC_UNCORRECTABLE;
+	}
+	return found;
+}
+
+uint8_t program_page_ecc(uint8_t* address, uint8_t* data, uint8_t* metadata)
+{
+	uint16_t page_size = device_geometry.page_size;
+	uint8_t* spare = ecc_page_buffer+page_size;
+
+	memcpy(ecc_page_buffer,data,page_size);
+	memset(spare,0xff,device_geometry.spare_size);
+	// without metadata the 0xff bytes are encoded, so the metadata codeword is always valid
+	if(metadata!=NULL)
+	{
+		memcpy(spare+ECC_SPARE_METADATA_OFFSET,metadata,ECC_METADATA_SIZE);
+	}
+	bch_encode(spare+ECC_SPARE_METADATA_OFFSET,ECC_METADATA_SIZE,spare+ECC_SPARE_METADATA_PARITY_OFFSET);
+	for(uint8_t i=0;i<ecc_codewords_per_page();i++)
+	{
+		bch_encode(data+i*ECC_CODEWORD_SIZE,ECC_CODEWORD_SIZE,spare+ECC_SPARE_PARITY_OFFSET+i*ECC_PARITY_BYTES);
+	}
+
+	uint8_t status_value = nand_wait(nand_submit_program(address,ecc_page_buffer,page_size+device_geometry.spare_size));
+	if(status_value&STATUS_FAIL)
+	{
+		printf("Failed Program Operation\n");
+	}
+	return status_value;
+}
+
+int16_t read_page_ecc(uint8_t* address, uint8_t* data, uint8_t* metadata)
+{
+	uint8_t* spare = ecc_page_buffer+device_geometry.page_size;
+	int16_t most_corrected = 0;
+
+	// data straight in to the caller's buffer, the spare area after it
+	read_page(address,full_address_cycles());
+	get_data_while_busy(data,device_geometry.page_size);
+	get_data_while_busy(spare,device_geometry.spare_size);
+
+	// an erased page has no valid parity, it is cleaned up instead of decoded
+	// .. a written page fails this on its first words
+	uint32_t zeros = count_zero_bits(data,device_geometry.page_size,BLANK_BITFLIP_THRESHOLD);
+	if(zeros<=BLANK_BITFLIP_THRESHOLD && count_zero_bits(spare,device_geometry.spare_size,BLANK_BITFLIP_THRESHOLD-zeros)<=BLANK_BITFLIP_THRESHOLD-zeros)
+	{
+		memset(data,0xff,device_geometry.page_size);
+		if(metadata!=NULL)
+		{
+			memset(metadata,0xff,ECC_METADATA_SIZE);
+		}
+		return ECC_ERASED;
+	}
+
+	for(uint8_t i=0;i<ecc_codewords_per_page();i++)
+	{
+		int16_t corrected = bch_decode(data+i*ECC_CODEWORD_SIZE,ECC_CODEWORD_SIZE,spare+ECC_SPARE_PARITY_OFFSET+i*ECC_PARITY_BYTES);
+		if(corrected==ECC_UNCORRECTABLE)
+		{
+			printf("Uncorrectable codeword %d\n",i);
+			most_corrected = ECC_UNCORRECTABLE;
+		}else if(most_corrected!=ECC_UNCORRECTABLE && corrected>most_corrected)
+		{
+			most_corrected = corrected;
+		}
+	}
+	if(metadata!=NULL)
+	{
+		int16_t corrected = bch_decode(spare+ECC_SPARE_METADATA_OFFSET,ECC_METADATA_SIZE,spare+ECC_SPARE_METADATA_PARITY_OFFSET);
+		if(corrected==ECC_UNCORRECTABLE)
+		{
+			printf("Uncorrectable metadata\n");
+			most_corrected = ECC_UNCORRECTABLE;
+		}else if(most_corrected!=ECC_UNCORRECTABLE && corrected>most_corrected)
+		{
+			most_corrected = corrected;
+		}
+		memcpy(metadata,spare+ECC_SPARE_METADATA_OFFSET,ECC_METADATA_SIZE);
+	}
+	return most_corrected;
+}
@@ -0,0 +1,71 @@
+/*
+File: nand_ecc.h
+Description: BCH error correction for the page data and metadata
+			.. binary BCH over GF(2^14) correcting up to 40 bit errors per codeword
+			.. each 1024-byte piece of the page is one codeword with 70 bytes of parity in the spare area
+			.. parity is generated with a byte-wise table, the syndromes with per-syndrome byte tables
+			.. a codeword whose parity matches is taken as it is (no syndromes, no Chien search)
+			.. Each of the functions declared here are defined in file nand_ecc.c
+*/
+#ifndef nand_ecc_h
+#define nand_ecc_h
+
+#include "nand_interface_header.h"
+
+// code parameters
+#define ECC_M 14
+#define ECC_T 40
+#define ECC_N ((1<<ECC_M)-1)
+#define ECC_PARITY_BITS (ECC_M*ECC_T)
+#define ECC_PARITY_BYTES ((ECC_PARITY_BITS+7)/8)
+#define ECC_PARITY_WORDS ((ECC_PARITY_BITS+31)/32)
+// .. longest data part of a codeword
+#define ECC_MAX_DATA_BYTES ((ECC_N-ECC_PARITY_BITS)/8)
+
+// page layout
+// .. the page data is split in codewords of ECC_CODEWORD_SIZE bytes
+// .. the spare area holds:
+// .. .. [0,2): bad block marker, left at 0xff
+// .. .. [2,34): ECC_METADATA_SIZE bytes of metadata for the user (own codeword)
+// .. .. [34,104): parity of the metadata
+// .. .. [104,...): parity of the data codewords, ECC_PARITY_BYTES each, in order
+// .. for 8192+744 that is 8 codewords and ends at byte 664 of the spare area
+#define ECC_CODEWORD_SIZE 1024
+#define ECC_METADATA_SIZE 32
+#define ECC_SPARE_METADATA_OFFSET 2
+#define ECC_SPARE_METADATA_PARITY_OFFSET (ECC_SPARE_METADATA_OFFSET+ECC_METADATA_SIZE)
+#define ECC_SPARE_PARITY_OFFSET (ECC_SPARE_METADATA_PARITY_OFFSET+ECC_PARITY_BYTES)
+
+// returned by the decoders when a codeword has more errors than can be corrected
+#define ECC_UNCORRECTABLE (-1)
+// returned by read_page_ecc for an erased page (within BLANK_BITFLIP_THRESHOLD), data is all 0xff
+#define ECC_ERASED (-2)
+
+// function to build the tables of the field, the encoder and the syndromes
+// .. must be called once before anything else in here
+// .. returns false if the page layout does not fit the spare area of device_geometry
+bool ecc_init();
+
+// function to compute the parity of len bytes of data (len up to ECC_MAX_DATA_BYTES)
+// .. parity gets ECC_PARITY_BYTES bytes
+void bch_encode(uint8_t* data, uint16_t len, uint8_t* parity);
+
+// function to correct len bytes of data with its parity, both are corrected in place
+// .. returns the number of bits corrected, or ECC_UNCORRECTABLE
+int16_t bch_decode(uint8_t* data, uint16_t len, uint8_t* parity);
+
+// number of data codewords in one page of device_geometry
+uint8_t ecc_codewords_per_page();
+
+// function to program a page with its parity
+// .. data has device_geometry.page_size bytes, metadata has ECC_METADATA_SIZE bytes (or NULL for none)
+// .. address is column and row address, the column should be 0
+// .. returns the status register value
+uint8_t program_page_ecc(uint8_t* address, uint8_t* data, uint8_t* metadata);
+
+// function to read a page and correct it
+// .. data gets device_geometry.page_size bytes, metadata ECC_METADATA_SIZE bytes (can be NULL)
+// .. returns the largest number of bits corrected in one codeword, ECC_UNCORRECTABLE or ECC_ERASED
+int16_t read_page_ecc(uint8_t* address, uint8_t* data, uint8_t* metadata);
+
+#endif
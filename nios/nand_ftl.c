@@ -0,0 +1,1129 @@
+#include "nand_ftl.h"
+
+ftl_statistics ftl_stats;
+
+// logical to physical map, allocated in whole pages so it is written and read straight from here
+uint32_t* ftl_l2p = NULL;
+uint32_t ftl_num_logical = 0;
+
+// one bit per physical unit, set while the unit holds the newest copy of its logical unit
+uint8_t* ftl_valid = NULL;
+uint16_t* ftl_valid_count = NULL;
+uint8_t* ftl_block_state = NULL;
+// sequence of the last page written in each block, the age for cost-benefit
+uint32_t* ftl_block_sequence = NULL;
+
+// blocks [0,ftl_num_blocks) belong to the FTL, the bad block table keeps the ones after
+// .. the free ones are in the heap of the wear leveling
+uint32_t ftl_num_blocks = 0;
+
+// block static wear leveling is moving the data out of, and the next page to look at
+uint32_t ftl_cold_block = FTL_INVALID;
+uint32_t ftl_cold_page = 0;
+// set by each erase of a data block, the only time the spread can grow
+bool ftl_wear_check = false;
+
+// sequence of the last page written
+uint32_t ftl_sequence = 0;
+
+// page being filled: open block, page in it and the units already in the buffer
+uint32_t ftl_open_block = FTL_INVALID;
+uint32_t ftl_open_page = 0;
+uint8_t* ftl_page_buffer = NULL;
+uint32_t ftl_buffer_lpn[FTL_MAX_UNITS_PER_PAGE];
+uint8_t ftl_buffer_fill = 0;
+
+// page buffer for garbage collection
+uint8_t* ftl_gc_buffer = NULL;
+
+// two checkpoint areas of ftl_area_blocks blocks each, area 0 first
+// .. page 0 of a checkpoint holds ftl_area_blocks and this list, the map and the erase counts follow
+uint32_t* ftl_area = NULL;
+uint32_t ftl_area_blocks = 0;
+uint8_t ftl_next_area = 0;
+uint32_t ftl_pages_since_checkpoint = 0;
+
+#define FTL_CODEWORDS_PER_UNIT (FTL_UNIT_SIZE/ECC_CODEWORD_SIZE)
+
+FORCE_INLINE inline uint8_t ftl_units_per_page()
+{
+	return device_geometry.page_size/FTL_UNIT_SIZE;
+}
+
+FORCE_INLINE inline uint32_t ftl_units_per_block()
+{
+	return ftl_units_per_page()*device_geometry.pages_per_block;
+}
+
+FORCE_INLINE inline uint32_t ftl_ppa(uint32_t block, uint32_t page, uint8_t slot)
+{
+	return block*ftl_units_per_block()+page*ftl_units_per_page()+slot;
+}
+
+FORCE_INLINE inline bool ftl_is_valid(uint32_t ppa)
+{
+	return (ftl_valid[ppa>>3]>>(ppa&7))&1;
+}
+
+void ftl_page_address(uint32_t block, uint32_t page, uint16_t column, uint8_t* address)
+{
+	make_page_address(block/device_geometry.blocks_per_lun,block%device_geometry.blocks_per_lun,page,column,address);
+}
+
+uint32_t ftl_checkpoint_pages()
+{
+	return (ftl_num_logical*sizeof(uint32_t)+device_geometry.page_size-1)/device_geometry.page_size;
+}
+
+// the area list, then the map, then the erase counts
+FORCE_INLINE inline uint32_t ftl_checkpoint_total_pages()
+{
+	return 1+ftl_checkpoint_pages()+wl_count_pages();
+}
+
+uint32_t ftl_capacity()
+{
+	return ftl_num_logical;
+}
+
+// metadata to and from the bytes in the spare area
+void ftl_pack_metadata(uint8_t type, uint32_t sequence, uint32_t* lpn, uint8_t* raw)
+{
+	ftl_page_metadata metadata;
+
+	memset(raw,0xff,ECC_METADATA_SIZE);
+	metadata.magic = FTL_MAGIC;
+	metadata.sequence = sequence;
+	memcpy(metadata.lpn,lpn,sizeof(metadata.lpn));
+	metadata.type = type;
+	memcpy(raw,&metadata,sizeof(metadata));
+}
+
+// reads only the metadata of a page
+// .. returns 1 for a page written by the FTL, 0 for an erased page, -1 for anything else
+int8_t ftl_read_metadata(uint32_t block, uint32_t page, ftl_page_metadata* metadata)
+{
+	uint8_t address[MAX_ADDRESS_CYCLES];
+	uint8_t raw[ECC_METADATA_SIZE+ECC_PARITY_BYTES];
+	read_segment segment = {device_geometry.page_size+ECC_SPARE_METADATA_OFFSET,sizeof(raw),raw};
+
+	ftl_page_address(block,page,0,address);
+	read_page_vectored(address,&segment,1);
+	if(is_erased(raw,sizeof(raw),BLANK_BITFLIP_THRESHOLD))
+	{
+		return 0;
+	}
+	if(bch_decode(raw,ECC_METADATA_SIZE,raw+ECC_METADATA_SIZE)==ECC_UNCORRECTABLE)
+	{
+		return -1;
+	}
+	memcpy(metadata,raw,sizeof(*metadata));
+	return (metadata->magic==FTL_MAGIC)?1:-1;
+}
+
+// reads one unit and the parity of its codewords, and the page metadata if metadata is not NULL
+bool ftl_read_unit(uint32_t ppa, uint8_t* data, ftl_page_metadata* metadata)
+{
+	uint8_t address[MAX_ADDRESS_CYCLES];
+	uint8_t parity[FTL_CODEWORDS_PER_UNIT*ECC_PARITY_BYTES];
+	uint8_t raw[ECC_METADATA_SIZE+ECC_PARITY_BYTES];
+	uint32_t page_number = ppa/ftl_units_per_page();
+	uint8_t slot = ppa%ftl_units_per_page();
+	bool correct = true;
+
+	read_segment segments[3] =
+	{
+		{slot*FTL_UNIT_SIZE,FTL_UNIT_SIZE,data},
+		{device_geometry.page_size+ECC_SPARE_PARITY_OFFSET+slot*sizeof(parity),sizeof(parity),parity},
+		{device_geometry.page_size+ECC_SPARE_METADATA_OFFSET,sizeof(raw),raw},
+	};
+	ftl_page_address(page_number/device_geometry.pages_per_block,page_number%device_geometry.pages_per_block,0,address);
+	read_page_vectored(address,segments,(metadata!=NULL)?3:2);
+
+	for(uint8_t i=0;i<FTL_CODEWORDS_PER_UNIT;i++)
+	{
+		if(bch_decode(data+i*ECC_CODEWORD_SIZE,ECC_CODEWORD_SIZE,parity+i*ECC_PARITY_BYTES)==ECC_UNCORRECTABLE)
+		{
+			correct = false;
+		}
+	}
+	if(metadata!=NULL)
+	{
+		if(bch_decode(raw,ECC_METADATA_SIZE,raw+ECC_METADATA_SIZE)==ECC_UNCORRECTABLE)
+		{
+			correct = false;
+		}
+		memcpy(metadata,raw,sizeof(*metadata));
+	}
+	if(!correct)
+	{
+		printf("Uncorrectable unit %lu\n",(unsigned long)ppa);
+	}
+	return correct;
+}
+
+// the unit at ppa is no longer the newest copy of its logical unit
+void ftl_invalidate(uint32_t ppa)
+{
+	uint32_t block = ppa/ftl_units_per_block();
+
+	ftl_valid[ppa>>3] &= ~(1<<(ppa&7));
+	ftl_valid_count[block]--;
+	if(ftl_valid_count[block]==0 && ftl_block_state[block]==FTL_BLOCK_FULL)
+	{
+		ftl_block_state[block] = FTL_BLOCK_FREE;
+		if(!bbt_is_bad(block))
+		{
+			wl_release(block);
+		}
+	}
+}
+
+void ftl_map(uint32_t lpn, uint32_t ppa)
+{
+	if(ftl_l2p[lpn]!=FTL_INVALID && ftl_l2p[lpn]!=FTL_UNREADABLE)
+	{
+		ftl_invalidate(ftl_l2p[lpn]);
+	}
+	ftl_l2p[lpn] = ppa;
+	ftl_valid[ppa>>3] |= 1<<(ppa&7);
+	ftl_valid_count[ppa/ftl_units_per_block()]++;
+}
+
+// takes the least worn free block, erases it and makes it the open block
+bool ftl_open_new_block()
+{
+	uint32_t block;
+
+	while((block = wl_allocate())!=WL_NONE)
+	{
+		uint8_t row_address[MAX_ROW_ADDRESS_CYCLES];
+
+		bbt_row_of(block,row_address);
+		ftl_stats.blocks_erased++;
+		wl_erased(block);
+		ftl_wear_check = true;
+		if(nand_wait(nand_submit_erase(row_address))&STATUS_FAIL)
+		{
+			// the failure hook has marked it bad
+			continue;
+		}
+		if(block==ftl_cold_block)
+		{
+			ftl_cold_block = FTL_INVALID;
+		}
+		ftl_block_state[block] = FTL_BLOCK_OPEN;
+		ftl_open_block = block;
+		ftl_open_page = 0;
+		return true;
+	}
+	printf("FTL has no free block\n");
+	return false;
+}
+
+// programs the page buffer to the open page
+// .. a failed program gives up the block (now bad) and moves the units to a new one
+bool ftl_program_buffer()
+{
+	uint8_t units_per_page = ftl_units_per_page();
+	uint8_t address[MAX_ADDRESS_CYCLES];
+	uint8_t metadata[ECC_METADATA_SIZE];
+	uint32_t lpn[FTL_MAX_UNITS_PER_PAGE];
+
+	for(uint8_t slot=0;slot<FTL_MAX_UNITS_PER_PAGE;slot++)
+	{
+		lpn[slot] = (slot<units_per_page)?ftl_buffer_lpn[slot]:FTL_INVALID;
+	}
+
+	while(true)
+	{
+		ftl_sequence++;
+		ftl_pack_metadata(FTL_PAGE_DATA,ftl_sequence,lpn,metadata);
+		ftl_page_address(ftl_open_block,ftl_open_page,0,address);
+		ftl_stats.pages_programmed++;
+		if(!(program_page_ecc(address,ftl_page_buffer,metadata)&STATUS_FAIL))
+		{
+			break;
+		}
+
+		// .. a unit written twice in the same page only moves its newest copy
+		bool live[FTL_MAX_UNITS_PER_PAGE];
+		ftl_block_state[ftl_open_block] = FTL_BLOCK_FULL;
+		for(uint8_t slot=0;slot<units_per_page;slot++)
+		{
+			live[slot] = lpn[slot]!=FTL_INVALID && ftl_l2p[lpn[slot]]==ftl_ppa(ftl_open_block,ftl_open_page,slot);
+		}
+		for(uint8_t slot=0;slot<units_per_page;slot++)
+		{
+			if(live[slot])
+			{
+				ftl_invalidate(ftl_l2p[lpn[slot]]);
+				ftl_l2p[lpn[slot]] = FTL_INVALID;
+			}
+		}
+		if(ftl_valid_count[ftl_open_block]==0)
+		{
+			ftl_block_state[ftl_open_block] = FTL_BLOCK_FREE;
+		}
+		if(!ftl_open_new_block())
+		{
+			return false;
+		}
+		for(uint8_t slot=0;slot<units_per_page;slot++)
+		{
+			if(live[slot])
+			{
+				ftl_map(lpn[slot],ftl_ppa(ftl_open_block,0,slot));
+			}
+		}
+	}
+
+	ftl_block_sequence[ftl_open_block] = ftl_sequence;
+	ftl_buffer_fill = 0;
+	ftl_pages_since_checkpoint++;
+	ftl_open_page++;
+	if(ftl_open_page==device_geometry.pages_per_block)
+	{
+		ftl_block_state[ftl_open_block] = FTL_BLOCK_FULL;
+		ftl_open_block = FTL_INVALID;
+	}
+	return true;
+}
+
+// puts one unit in the page buffer, the page is programmed once it is full
+bool ftl_append(uint32_t lpn, uint8_t* data)
+{
+	if(ftl_buffer_fill==0 && ftl_open_block==FTL_INVALID)
+	{
+		if(!ftl_open_new_block())
+		{
+			return false;
+		}
+	}
+	memcpy(ftl_page_buffer+ftl_buffer_fill*FTL_UNIT_SIZE,data,FTL_UNIT_SIZE);
+	ftl_buffer_lpn[ftl_buffer_fill] = lpn;
+	ftl_map(lpn,ftl_ppa(ftl_open_block,ftl_open_page,ftl_buffer_fill));
+	ftl_buffer_fill++;
+
+	if(ftl_buffer_fill==ftl_units_per_page())
+	{
+		return ftl_program_buffer();
+	}
+	return true;
+}
+
+// programs a partly filled page buffer, the rest of the page is padding
+bool ftl_flush_buffer()
+{
+	if(ftl_buffer_fill==0)
+	{
+		return true;
+	}
+	for(uint8_t slot=ftl_buffer_fill;slot<ftl_units_per_page();slot++)
+	{
+		memset(ftl_page_buffer+slot*FTL_UNIT_SIZE,0xff,FTL_UNIT_SIZE);
+		ftl_buffer_lpn[slot] = FTL_INVALID;
+		ftl_stats.pad_units++;
+	}
+	return ftl_program_buffer();
+}
+
+// full block to collect next, FTL_INVALID if none would free anything
+uint32_t ftl_select_victim()
+{
+	uint32_t units_per_block = ftl_units_per_block();
+	uint32_t victim = FTL_INVALID;
+	uint64_t best_score = 0;
+
+	for(uint32_t block=0;block<ftl_num_blocks;block++)
+	{
+		uint32_t valid = ftl_valid_count[block];
+
+		if(ftl_block_state[block]!=FTL_BLOCK_FULL || valid>=units_per_block)
+		{
+			continue;
+		}
+#if FTL_GC_POLICY==FTL_GC_GREEDY
+		uint64_t score = units_per_block-valid;
+#else
+		uint64_t age = ftl_sequence-ftl_block_sequence[block]+1;
+		uint64_t score = (valid==0)?UINT64_MAX:((uint64_t)(units_per_block-valid)*age<<8)/(2*valid);
+#endif
+		if(victim==FTL_INVALID || score>best_score)
+		{
+			victim = block;
+			best_score = score;
+		}
+	}
+	return victim;
+}
+
+// logical unit whose newest copy is at ppa, FTL_INVALID if none
+// .. a search of the whole map, only for a page whose metadata cannot be decoded
+uint32_t ftl_lpn_of(uint32_t ppa)
+{
+	for(uint32_t lpn=0;lpn<ftl_num_logical;lpn++)
+	{
+		if(ftl_l2p[lpn]==ppa)
+		{
+			return lpn;
+		}
+	}
+	return FTL_INVALID;
+}
+
+// moves the valid units of one page to the open block, counter counts them
+// .. if the page does not decode the map gives the logical units and each unit is decoded on its own
+// .. .. a unit that still fails is never written again with new parity, its logical unit becomes FTL_UNREADABLE
+bool ftl_move_page(uint32_t block, uint32_t page, uint32_t* counter)
+{
+	uint8_t units_per_page = ftl_units_per_page();
+	uint32_t first = ftl_ppa(block,page,0);
+	uint8_t num_valid = 0;
+	uint8_t last_valid = 0;
+	bool readable;
+	ftl_page_metadata metadata;
+
+	for(uint8_t slot=0;slot<units_per_page;slot++)
+	{
+		if(ftl_is_valid(first+slot))
+		{
+			num_valid++;
+			last_valid = slot;
+		}
+	}
+	if(num_valid==0)
+	{
+		return true;
+	}
+
+	// one unit alone is read on its own, more take the whole page
+	if(num_valid==1)
+	{
+		readable = ftl_read_unit(first+last_valid,ftl_gc_buffer+last_valid*FTL_UNIT_SIZE,&metadata);
+	}else
+	{
+		uint8_t address[MAX_ADDRESS_CYCLES];
+		uint8_t raw[ECC_METADATA_SIZE];
+
+		ftl_page_address(block,page,0,address);
+		// .. a page with valid units is never erased, so ECC_ERASED is a failure too
+		readable = read_page_ecc(address,ftl_gc_buffer,raw)>=0;
+		memcpy(&metadata,raw,sizeof(metadata));
+	}
+
+	for(uint8_t slot=0;slot<units_per_page;slot++)
+	{
+		uint32_t lpn = metadata.lpn[slot];
+
+		if(!ftl_is_valid(first+slot))
+		{
+			continue;
+		}
+		if(!readable)
+		{
+			lpn = ftl_lpn_of(first+slot);
+			if(lpn==FTL_INVALID)
+			{
+				printf("FTL map has no unit at page %lu of block %lu\n",(unsigned long)page,(unsigned long)block);
+				ftl_invalidate(first+slot);
+				continue;
+			}
+			if(!ftl_read_unit(first+slot,ftl_gc_buffer+slot*FTL_UNIT_SIZE,NULL))
+			{
+				printf("Logical unit %lu lost at page %lu of block %lu\n",(unsigned long)lpn,(unsigned long)page,(unsigned long)block);
+				ftl_invalidate(first+slot);
+				ftl_l2p[lpn] = FTL_UNREADABLE;
+				continue;
+			}
+		}else if(lpn>=ftl_num_logical || ftl_l2p[lpn]!=first+slot)
+		{
+			printf("FTL map and page %lu of block %lu do not agree\n",(unsigned long)page,(unsigned long)block);
+			ftl_invalidate(first+slot);
+			continue;
+		}
+		if(!ftl_append(lpn,ftl_gc_buffer+slot*FTL_UNIT_SIZE))
+		{
+			return false;
+		}
+		(*counter)++;
+	}
+	return true;
+}
+
+bool ftl_collect()
+{
+	uint32_t victim = ftl_select_victim();
+
+	if(victim==FTL_INVALID)
+	{
+		return false;
+	}
+	ftl_stats.gc_runs++;
+
+	for(uint32_t page=0;page<device_geometry.pages_per_block && ftl_valid_count[victim]>0;page++)
+	{
+		if(!ftl_move_page(victim,page,&ftl_stats.gc_units))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// full block with the lowest erase count, if it is cold enough to move
+uint32_t ftl_select_cold()
+{
+	uint32_t cold = FTL_INVALID;
+
+	for(uint32_t block=0;block<ftl_num_blocks;block++)
+	{
+		if(ftl_block_state[block]==FTL_BLOCK_FULL && (cold==FTL_INVALID || wl_erase_count[block]<wl_erase_count[cold]))
+		{
+			cold = block;
+		}
+	}
+	return (cold!=FTL_INVALID && wl_is_cold(cold))?cold:FTL_INVALID;
+}
+
+// static wear leveling: moves up to WL_PAGE_BUDGET pages out of the cold block
+// .. once the block has nothing valid it is free and, being the least worn, the next one opened
+bool ftl_wear_level()
+{
+	uint32_t budget = WL_PAGE_BUDGET;
+
+	if(ftl_cold_block==FTL_INVALID && ftl_wear_check)
+	{
+		ftl_wear_check = false;
+		ftl_cold_block = ftl_select_cold();
+		ftl_cold_page = 0;
+		if(ftl_cold_block!=FTL_INVALID)
+		{
+			ftl_stats.wear_level_runs++;
+		}
+	}
+	while(ftl_cold_block!=FTL_INVALID && budget>0)
+	{
+		// .. garbage collection may have emptied it first
+		if(ftl_block_state[ftl_cold_block]!=FTL_BLOCK_FULL || ftl_cold_page==device_geometry.pages_per_block)
+		{
+			ftl_cold_block = FTL_INVALID;
+			break;
+		}
+		uint32_t first = ftl_ppa(ftl_cold_block,ftl_cold_page,0);
+		for(uint8_t slot=0;slot<ftl_units_per_page();slot++)
+		{
+			if(ftl_is_valid(first+slot))
+			{
+				budget--;
+				break;
+			}
+		}
+		if(!ftl_move_page(ftl_cold_block,ftl_cold_page,&ftl_stats.wear_level_units))
+		{
+			return false;
+		}
+		ftl_cold_page++;
+	}
+	return true;
+}
+
+// erases the next checkpoint area and writes the area list, the map and the erase counts to it
+// .. returns FTL_INVALID, or the index in ftl_area of the block that is bad or failed
+uint32_t ftl_write_area()
+{
+	uint32_t first = ftl_next_area*ftl_area_blocks;
+	uint32_t* area = ftl_area+first;
+	uint32_t map_pages = ftl_checkpoint_pages();
+	uint32_t num_pages = ftl_checkpoint_total_pages();
+	uint8_t metadata[ECC_METADATA_SIZE];
+
+	// every attempt has its own sequence, pages left by a failed one are never taken for a whole checkpoint
+	ftl_sequence++;
+
+	for(uint32_t i=0;i<ftl_area_blocks;i++)
+	{
+		uint8_t row_address[MAX_ROW_ADDRESS_CYCLES];
+
+		if(bbt_is_bad(area[i]))
+		{
+			return first+i;
+		}
+		bbt_row_of(area[i],row_address);
+		ftl_stats.blocks_erased++;
+		wl_erased(area[i]);
+		if(nand_wait(nand_submit_erase(row_address))&STATUS_FAIL)
+		{
+			printf("Failed Checkpoint Erase\n");
+			return first+i;
+		}
+	}
+
+	// the rest of the list page is zeroed, a page of mostly 0xff would be taken as erased
+	memset(ftl_gc_buffer,0,device_geometry.page_size);
+	memcpy(ftl_gc_buffer,&ftl_area_blocks,sizeof(uint32_t));
+	memcpy(ftl_gc_buffer+sizeof(uint32_t),ftl_area,2*ftl_area_blocks*sizeof(uint32_t));
+	for(uint32_t i=0;i<num_pages;i++)
+	{
+		uint8_t address[MAX_ADDRESS_CYCLES];
+		uint32_t info[FTL_MAX_UNITS_PER_PAGE] = {i,num_pages,ftl_num_logical,ftl_next_area};
+		uint8_t* data = (i==0)?ftl_gc_buffer:
+			(i<=map_pages)?(uint8_t*)ftl_l2p+(i-1)*device_geometry.page_size:(uint8_t*)wl_erase_count+(i-1-map_pages)*device_geometry.page_size;
+
+		ftl_pack_metadata(FTL_PAGE_CHECKPOINT,ftl_sequence,info,metadata);
+		ftl_page_address(area[i/device_geometry.pages_per_block],i%device_geometry.pages_per_block,0,address);
+		ftl_stats.pages_programmed++;
+		if(program_page_ecc(address,data,metadata)&STATUS_FAIL)
+		{
+			printf("Failed Checkpoint Program\n");
+			return first+i/device_geometry.pages_per_block;
+		}
+	}
+	return FTL_INVALID;
+}
+
+// a free block takes the place of a checkpoint block, the failure hook has marked that one bad
+bool ftl_replace_area_block(uint32_t index)
+{
+	uint32_t block = wl_allocate();
+
+	if(block==WL_NONE)
+	{
+		printf("No free block to replace checkpoint block %lu\n",(unsigned long)ftl_area[index]);
+		return false;
+	}
+	printf("Checkpoint block %lu replaced by block %lu\n",(unsigned long)ftl_area[index],(unsigned long)block);
+	ftl_area[index] = block;
+	ftl_block_state[block] = FTL_BLOCK_CHECKPOINT;
+	return true;
+}
+
+// writes the map and the erase counts to the next checkpoint area
+// .. a block that fails is replaced and the whole checkpoint written again, its list records the new block
+bool ftl_checkpoint()
+{
+	uint32_t failed;
+
+	// the map may not point at units still in the buffer
+	if(!ftl_flush_buffer())
+	{
+		return false;
+	}
+
+	while((failed = ftl_write_area())!=FTL_INVALID)
+	{
+		if(!ftl_replace_area_block(failed))
+		{
+			bbt_flush();
+			return false;
+		}
+	}
+
+	ftl_next_area ^= 1;
+	ftl_pages_since_checkpoint = 0;
+	ftl_stats.checkpoints++;
+	// blocks that failed since the last checkpoint
+	return bbt_flush();
+}
+
+bool ftl_sync()
+{
+	return ftl_checkpoint();
+}
+
+bool ftl_write(uint32_t lpn, uint8_t* data)
+{
+	if(lpn>=ftl_num_logical)
+	{
+		printf("Logical unit %lu out of range\n",(unsigned long)lpn);
+		return false;
+	}
+	// .. each collection frees its victim, the bound only stops a device with nothing left to gain
+	for(uint32_t runs=0;wl_free_blocks()<FTL_GC_FREE_BLOCKS && runs<ftl_num_blocks && ftl_collect();runs++);
+	if(!ftl_wear_level())
+	{
+		return false;
+	}
+
+	ftl_stats.host_units++;
+	if(!ftl_append(lpn,data))
+	{
+		return false;
+	}
+#if FTL_CHECKPOINT_INTERVAL
+	if(ftl_pages_since_checkpoint>=FTL_CHECKPOINT_INTERVAL)
+	{
+		return ftl_checkpoint();
+	}
+#endif
+	return true;
+}
+
+bool ftl_read(uint32_t lpn, uint8_t* data)
+{
+	if(lpn>=ftl_num_logical)
+	{
+		printf("Logical unit %lu out of range\n",(unsigned long)lpn);
+		return false;
+	}
+	uint32_t ppa = ftl_l2p[lpn];
+	if(ppa==FTL_INVALID)
+	{
+		memset(data,0xff,FTL_UNIT_SIZE);
+		return true;
+	}
+	if(ppa==FTL_UNREADABLE)
+	{
+		printf("Logical unit %lu was lost\n",(unsigned long)lpn);
+		return false;
+	}
+	// still in the page buffer
+	uint32_t page_number = ppa/ftl_units_per_page();
+	if(ftl_open_block!=FTL_INVALID && page_number==ftl_open_block*device_geometry.pages_per_block+ftl_open_page)
+	{
+		memcpy(data,ftl_page_buffer+(ppa%ftl_units_per_page())*FTL_UNIT_SIZE,FTL_UNIT_SIZE);
+		return true;
+	}
+	return ftl_read_unit(ppa,data,NULL);
+}
+
+// allocates everything but the map
+bool ftl_setup()
+{
+	uint32_t units_per_block = ftl_units_per_block();
+
+	if(device_geometry.page_size%FTL_UNIT_SIZE || ftl_units_per_page()>FTL_MAX_UNITS_PER_PAGE)
+	{
+		printf("Page size %d does not hold whole FTL units\n",device_geometry.page_size);
+		return false;
+	}
+	ftl_num_blocks = bbt_usable_blocks();
+	if(!wl_init(ftl_num_blocks))
+	{
+		return false;
+	}
+
+	free(ftl_valid);
+	free(ftl_valid_count);
+	free(ftl_block_state);
+	free(ftl_block_sequence);
+	free(ftl_page_buffer);
+	free(ftl_gc_buffer);
+	free(ftl_area);
+	ftl_valid = (uint8_t*)calloc((ftl_num_blocks*units_per_block+7)/8,1);
+	ftl_valid_count = (uint16_t*)calloc(ftl_num_blocks,sizeof(uint16_t));
+	ftl_block_state = (uint8_t*)calloc(ftl_num_blocks,1);
+	ftl_block_sequence = (uint32_t*)calloc(ftl_num_blocks,sizeof(uint32_t));
+	ftl_page_buffer = (uint8_t*)malloc(device_geometry.page_size);
+	ftl_gc_buffer = (uint8_t*)malloc(device_geometry.page_size);
+
+	// each area holds the area list, the map of the largest capacity and the erase counts
+	uint32_t area_pages = 1+((uint64_t)ftl_num_blocks*units_per_block*sizeof(uint32_t)+device_geometry.page_size-1)/device_geometry.page_size+wl_count_pages();
+	ftl_area_blocks = (area_pages+device_geometry.pages_per_block-1)/device_geometry.pages_per_block;
+	ftl_area = (uint32_t*)malloc(2*ftl_area_blocks*sizeof(uint32_t));
+	if(!ftl_valid || !ftl_valid_count || !ftl_block_state || !ftl_block_sequence || !ftl_page_buffer || !ftl_gc_buffer || !ftl_area)
+	{
+		printf("Not enough memory for the FTL\n");
+		return false;
+	}
+	if((1+2*ftl_area_blocks)*sizeof(uint32_t)>device_geometry.page_size)
+	{
+		printf("FTL checkpoint area list does not fit in a page\n");
+		return false;
+	}
+
+	ftl_open_block = FTL_INVALID;
+	ftl_buffer_fill = 0;
+	ftl_cold_block = FTL_INVALID;
+	ftl_wear_check = true;
+	ftl_pages_since_checkpoint = 0;
+	memset(&ftl_stats,0,sizeof(ftl_stats));
+
+	// the FTL programs and erases from now on
+	write_enable();
+	return true;
+}
+
+// allocates the map for ftl_num_logical units, all unmapped
+bool ftl_allocate_map()
+{
+	uint32_t size = ftl_checkpoint_pages()*device_geometry.page_size;
+
+	free(ftl_l2p);
+	ftl_l2p = (uint32_t*)malloc(size);
+	if(ftl_l2p==NULL)
+	{
+		printf("Not enough memory for the FTL map\n");
+		return false;
+	}
+	memset(ftl_l2p,0xff,size);
+	return true;
+}
+
+// the checkpoint areas are the first good blocks
+bool ftl_pick_areas()
+{
+	uint32_t block = 0;
+
+	for(uint32_t i=0;i<2*ftl_area_blocks;i++)
+	{
+		block = bbt_next_good_block(block);
+		if(block>=ftl_num_blocks)
+		{
+			printf("No room for the FTL checkpoint areas\n");
+			return false;
+		}
+		ftl_area[i] = block;
+		ftl_block_state[block] = FTL_BLOCK_CHECKPOINT;
+		block++;
+	}
+	return true;
+}
+
+// newest whole checkpoint: a first page and the last page its area list gives with the same sequence
+// .. the first page is looked for in every good block, its list is copied to ftl_area
+// .. returns its area, -1 if there is none
+int8_t ftl_find_checkpoint(uint32_t* sequence, uint32_t* num_pages, uint32_t* num_logical)
+{
+	uint32_t* list = (uint32_t*)(ftl_gc_buffer+sizeof(uint32_t));
+	int8_t best_area = -1;
+
+	for(uint32_t block=0;block<ftl_num_blocks;block++)
+	{
+		uint8_t address[MAX_ADDRESS_CYCLES];
+		ftl_page_metadata first;
+		ftl_page_metadata last;
+		uint32_t list_blocks;
+		bool valid = true;
+
+		if(bbt_is_bad(block) || ftl_read_metadata(block,0,&first)!=1 || first.type!=FTL_PAGE_CHECKPOINT || first.lpn[0]!=0
+			|| first.lpn[3]>1 || (best_area>=0 && first.sequence<=*sequence))
+		{
+			continue;
+		}
+		uint32_t pages = first.lpn[1];
+		if(pages<=1+wl_count_pages() || pages>ftl_area_blocks*device_geometry.pages_per_block)
+		{
+			continue;
+		}
+
+		// the list has to be of this geometry and put this block first in its area
+		ftl_page_address(block,0,0,address);
+		if(read_page_ecc(address,ftl_gc_buffer,NULL)<0)
+		{
+			continue;
+		}
+		memcpy(&list_blocks,ftl_gc_buffer,sizeof(uint32_t));
+		if(list_blocks!=ftl_area_blocks || list[first.lpn[3]*ftl_area_blocks]!=block)
+		{
+			continue;
+		}
+		for(uint32_t i=0;i<2*ftl_area_blocks;i++)
+		{
+			valid = valid && list[i]<ftl_num_blocks;
+		}
+		if(!valid)
+		{
+			continue;
+		}
+
+		uint32_t* blocks = list+first.lpn[3]*ftl_area_blocks;
+		if(ftl_read_metadata(blocks[(pages-1)/device_geometry.pages_per_block],(pages-1)%device_geometry.pages_per_block,&last)!=1
+			|| last.sequence!=first.sequence || last.lpn[0]!=pages-1)
+		{
+			continue;
+		}
+		memcpy(ftl_area,list,2*ftl_area_blocks*sizeof(uint32_t));
+		best_area = first.lpn[3];
+		*sequence = first.sequence;
+		*num_pages = pages;
+		*num_logical = first.lpn[2];
+	}
+	return best_area;
+}
+
+// reads pages [first,first+count) of a checkpoint into data
+bool ftl_read_checkpoint(uint8_t area, uint32_t first, uint32_t count, uint8_t* data)
+{
+	uint32_t* blocks = ftl_area+area*ftl_area_blocks;
+
+	for(uint32_t i=first;i<first+count;i++)
+	{
+		uint8_t address[MAX_ADDRESS_CYCLES];
+
+		ftl_page_address(blocks[i/device_geometry.pages_per_block],i%device_geometry.pages_per_block,0,address);
+		if(read_page_ecc(address,data+(i-first)*device_geometry.page_size,NULL)==ECC_UNCORRECTABLE)
+		{
+			printf("FTL checkpoint unreadable\n");
+			return false;
+		}
+	}
+	return true;
+}
+
+bool ftl_format(uint32_t num_logical_units)
+{
+	if(!ftl_setup())
+	{
+		return false;
+	}
+
+	// the erase counts carry on from the last checkpoint
+	uint32_t old_sequence = 0;
+	uint32_t old_pages = 0;
+	uint32_t old_logical = 0;
+	int8_t old_area = ftl_find_checkpoint(&old_sequence,&old_pages,&old_logical);
+	if(old_area>=0)
+	{
+		ftl_read_checkpoint(old_area,old_pages-wl_count_pages(),wl_count_pages(),(uint8_t*)wl_erase_count);
+		wl_counts_loaded();
+	}
+	// .. the areas are fixed from here on, the checkpoints carry the list
+	if(!ftl_pick_areas())
+	{
+		return false;
+	}
+
+	// capacity: good data blocks less the ones garbage collection needs, less over-provisioning
+	uint32_t data_blocks = 0;
+	for(uint32_t block=0;block<ftl_num_blocks;block++)
+	{
+		if(ftl_block_state[block]!=FTL_BLOCK_CHECKPOINT && !bbt_is_bad(block))
+		{
+			data_blocks++;
+		}
+	}
+	uint32_t limit = 0;
+	if(data_blocks>FTL_GC_FREE_BLOCKS+1)
+	{
+		limit = (uint64_t)(data_blocks-FTL_GC_FREE_BLOCKS-1)*ftl_units_per_block()*(100-FTL_OVERPROVISION_PERCENT)/100;
+	}
+	if(num_logical_units==0)
+	{
+		num_logical_units = limit;
+	}
+	if(num_logical_units==0 || num_logical_units>limit)
+	{
+		printf("FTL capacity %lu is more than %lu\n",(unsigned long)num_logical_units,(unsigned long)limit);
+		return false;
+	}
+
+	ftl_num_logical = num_logical_units;
+	if(!ftl_allocate_map())
+	{
+		return false;
+	}
+
+	// the new sequence numbers start above everything on the device
+	// .. blocks are written one after the other, so the newest page is in the block with the newest first page
+	uint32_t newest_block = FTL_INVALID;
+	ftl_sequence = 0;
+	wl_clear_free();
+	for(uint32_t block=0;block<ftl_num_blocks;block++)
+	{
+		ftl_page_metadata metadata;
+
+		if(bbt_is_bad(block))
+		{
+			continue;
+		}
+		if(ftl_read_metadata(block,0,&metadata)==1 && metadata.sequence>=ftl_sequence)
+		{
+			ftl_sequence = metadata.sequence;
+			newest_block = block;
+		}
+		if(ftl_block_state[block]==FTL_BLOCK_FREE)
+		{
+			wl_release(block);
+		}
+	}
+	for(uint32_t page=1;newest_block!=FTL_INVALID && page<device_geometry.pages_per_block;page++)
+	{
+		ftl_page_metadata metadata;
+		int8_t found = ftl_read_metadata(newest_block,page,&metadata);
+
+		if(found==0)
+		{
+			break;
+		}
+		if(found==1 && metadata.sequence>ftl_sequence)
+		{
+			ftl_sequence = metadata.sequence;
+		}
+	}
+	ftl_next_area = 0;
+	return ftl_checkpoint();
+}
+
+// block and the sequence of its first page, for the replay
+typedef struct
+{
+	uint32_t sequence;
+	uint32_t block;
+}ftl_block_order;
+
+int ftl_compare_block_order(const void* a, const void* b)
+{
+	uint32_t sequence_a = ((ftl_block_order*)a)->sequence;
+	uint32_t sequence_b = ((ftl_block_order*)b)->sequence;
+	return (sequence_a>sequence_b)-(sequence_a<sequence_b);
+}
+
+bool ftl_mount()
+{
+	ftl_page_metadata metadata;
+	int8_t best_area = -1;
+	uint32_t best_sequence = 0;
+	uint32_t num_pages = 0;
+
+	if(!ftl_setup())
+	{
+		return false;
+	}
+
+	best_area = ftl_find_checkpoint(&best_sequence,&num_pages,&ftl_num_logical);
+	if(best_area<0)
+	{
+		printf("No FTL checkpoint found, format first\n");
+		return false;
+	}
+	if(ftl_checkpoint_total_pages()!=num_pages)
+	{
+		printf("FTL checkpoint does not match the device\n");
+		return false;
+	}
+	// the areas are the ones in its list
+	for(uint32_t i=0;i<2*ftl_area_blocks;i++)
+	{
+		ftl_block_state[ftl_area[i]] = FTL_BLOCK_CHECKPOINT;
+	}
+	if(!ftl_allocate_map()
+		|| !ftl_read_checkpoint(best_area,1,ftl_checkpoint_pages(),(uint8_t*)ftl_l2p)
+		|| !ftl_read_checkpoint(best_area,1+ftl_checkpoint_pages(),wl_count_pages(),(uint8_t*)wl_erase_count))
+	{
+		return false;
+	}
+	wl_counts_loaded();
+	ftl_next_area = best_area^1;
+	ftl_sequence = best_sequence;
+
+	// data blocks in the order they were opened
+	ftl_block_order* order = (ftl_block_order*)malloc(ftl_num_blocks*sizeof(ftl_block_order));
+	uint32_t num_ordered = 0;
+	if(order==NULL)
+	{
+		printf("Not enough memory for the FTL replay\n");
+		return false;
+	}
+	for(uint32_t block=0;block<ftl_num_blocks;block++)
+	{
+		if(ftl_block_state[block]==FTL_BLOCK_CHECKPOINT)
+		{
+			continue;
+		}
+		ftl_block_state[block] = FTL_BLOCK_FULL;
+		int8_t found = ftl_read_metadata(block,0,&metadata);
+		if(found==1 && metadata.type==FTL_PAGE_DATA)
+		{
+			order[num_ordered].sequence = metadata.sequence;
+			order[num_ordered].block = block;
+			ftl_block_sequence[block] = metadata.sequence;
+			num_ordered++;
+		}
+		// a block erased after the checkpoint held nothing the checkpoint still needs
+		// .. the units it pointed at there were written again or moved by garbage collection
+		// .. its count misses that erase (and any before it since the checkpoint)
+		if(found==0 || (found==1 && metadata.sequence>best_sequence))
+		{
+			ftl_block_state[block] = FTL_BLOCK_FREE;
+			if(found==1)
+			{
+				wl_erased(block);
+			}
+		}
+	}
+	qsort(order,num_ordered,sizeof(ftl_block_order),ftl_compare_block_order);
+
+	// valid units of the checkpoint
+	for(uint32_t lpn=0;lpn<ftl_num_logical;lpn++)
+	{
+		uint32_t ppa = ftl_l2p[lpn];
+		if(ppa==FTL_INVALID || ppa==FTL_UNREADABLE)
+		{
+			continue;
+		}
+		if(ftl_block_state[ppa/ftl_units_per_block()]==FTL_BLOCK_FREE)
+		{
+			ftl_l2p[lpn] = FTL_INVALID;
+			continue;
+		}
+		ftl_valid[ppa>>3] |= 1<<(ppa&7);
+		ftl_valid_count[ppa/ftl_units_per_block()]++;
+	}
+
+	// pages written after the checkpoint are replayed in order
+	// .. they start in the last block opened before it, blocks never share a range of sequences
+	uint32_t start = 0;
+	for(uint32_t i=0;i<num_ordered;i++)
+	{
+		if(order[i].sequence<best_sequence)
+		{
+			start = i;
+		}
+	}
+	for(uint32_t i=start;i<num_ordered;i++)
+	{
+		uint32_t block = order[i].block;
+		uint32_t page;
+
+		for(page=0;page<device_geometry.pages_per_block;page++)
+		{
+			int8_t found = ftl_read_metadata(block,page,&metadata);
+			if(found==0)
+			{
+				break;
+			}
+			if(found<0 || metadata.type!=FTL_PAGE_DATA || metadata.sequence<=best_sequence)
+			{
+				continue;
+			}
+			for(uint8_t slot=0;slot<ftl_units_per_page();slot++)
+			{
+				if(metadata.lpn[slot]<ftl_num_logical)
+				{
+					ftl_map(metadata.lpn[slot],ftl_ppa(block,page,slot));
+				}
+			}
+			ftl_block_sequence[block] = metadata.sequence;
+			if(metadata.sequence>ftl_sequence)
+			{
+				ftl_sequence = metadata.sequence;
+			}
+		}
+		// the last block opened carries on where it stopped
+		if(i==num_ordered-1 && page<device_geometry.pages_per_block && !bbt_is_bad(block))
+		{
+			ftl_block_state[block] = FTL_BLOCK_OPEN;
+			ftl_open_block = block;
+			ftl_open_page = page;
+		}
+	}
+	free(order);
+
+	// the states are set again from the valid counts
+	// .. a block erased and written again after the checkpoint can go to 0 valid units and back during the replay
+	wl_clear_free();
+	for(uint32_t block=0;block<ftl_num_blocks;block++)
+	{
+		if(ftl_block_state[block]==FTL_BLOCK_CHECKPOINT || block==ftl_open_block)
+		{
+			continue;
+		}
+		ftl_block_state[block] = (ftl_valid_count[block]>0)?FTL_BLOCK_FULL:FTL_BLOCK_FREE;
+		if(ftl_valid_count[block]==0 && !bbt_is_bad(block))
+		{
+			wl_release(block);
+		}
+	}
+	return true;
+}
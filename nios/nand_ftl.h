@@ -0,0 +1,120 @@
+/*
+File: nand_ftl.h
+Description: Page-mapped flash translation layer
+			.. the host reads and writes logical units of FTL_UNIT_SIZE bytes, any unit at any time
+			.. .. each write goes to the next free unit of the open block, the old copy only becomes invalid
+			.. .. so a random write costs a share of a page program, not a block erase
+			.. a page holds page_size/FTL_UNIT_SIZE units and its ECC metadata holds their logical numbers
+			.. .. and a sequence number, which is enough to rebuild the map after the last checkpoint
+			.. garbage collection moves the valid units out of a full block so it can be erased again
+			.. free blocks are opened least worn first and cold data is moved out of blocks left behind (nand_wear_level.h)
+			.. the map and the erase counts are written to one of two checkpoint areas, alternately
+			.. .. the areas are the first good blocks at ftl_format(), their block list is the first page of every checkpoint
+			.. .. and ftl_mount() takes it from the newest one, a block that fails is replaced by a free block
+			.. needs ecc_init() and bbt_init() first
+			.. Each of the functions declared here are defined in file nand_ftl.c
+*/
+#ifndef nand_ftl_h
+#define nand_ftl_h
+
+#include "nand_interface_header.h"
+#include "nand_ecc.h"
+#include "nand_bad_block.h"
+#include "nand_wear_level.h"
+
+// size of a logical unit, a multiple of ECC_CODEWORD_SIZE
+#define FTL_UNIT_SIZE 4096
+#define FTL_MAX_UNITS_PER_PAGE 4
+
+// logical or physical unit that is not there
+#define FTL_INVALID 0xffffffff
+// map entry of a logical unit lost when it was moved (uncorrectable), it reads as an error until written again
+#define FTL_UNREADABLE 0xfffffffe
+
+// share of the data blocks kept out of the logical capacity, for garbage collection
+#ifndef FTL_OVERPROVISION_PERCENT
+	#define FTL_OVERPROVISION_PERCENT 7
+#endif
+
+// garbage collection runs before a write while fewer blocks than this are free
+#define FTL_GC_FREE_BLOCKS 3
+
+// victim selection
+// .. greedy: the block with the fewest valid units
+// .. cost-benefit: the block with the best (1-u)*age/(2u), u the valid share, age the writes since it was filled
+#define FTL_GC_GREEDY 0
+#define FTL_GC_COST_BENEFIT 1
+#ifndef FTL_GC_POLICY
+	#define FTL_GC_POLICY FTL_GC_COST_BENEFIT
+#endif
+
+// a checkpoint is written after this many page programs (0 for only at ftl_sync())
+#ifndef FTL_CHECKPOINT_INTERVAL
+	#define FTL_CHECKPOINT_INTERVAL 16384
+#endif
+
+// "FTL1" in the metadata of every page the FTL writes
+#define FTL_MAGIC 0x314c5446
+
+// kind of page
+#define FTL_PAGE_DATA 1
+#define FTL_PAGE_CHECKPOINT 2
+
+// ECC metadata of every page (fits in ECC_METADATA_SIZE)
+// .. data page: lpn has the logical unit of each slot (FTL_INVALID for padding)
+// .. checkpoint page: lpn has page index, number of pages and number of logical units of the checkpoint, and its area
+typedef struct
+{
+	uint32_t magic;
+	uint32_t sequence;
+	uint32_t lpn[FTL_MAX_UNITS_PER_PAGE];
+	uint8_t type;
+}ftl_page_metadata;
+
+// state of a block
+#define FTL_BLOCK_FREE 0		// nothing valid, erased when it is opened
+#define FTL_BLOCK_OPEN 1		// being written
+#define FTL_BLOCK_FULL 2		// written to the last page
+#define FTL_BLOCK_CHECKPOINT 3	// part of a checkpoint area
+
+typedef struct
+{
+	uint32_t host_units;		// units written by ftl_write
+	uint32_t gc_units;			// units moved by garbage collection
+	uint32_t wear_level_units;	// units moved by static wear leveling
+	uint32_t pad_units;			// empty units of pages written by ftl_sync
+	uint32_t pages_programmed;
+	uint32_t blocks_erased;
+	uint32_t gc_runs;
+	uint32_t wear_level_runs;
+	uint32_t checkpoints;
+}ftl_statistics;
+
+extern ftl_statistics ftl_stats;
+
+// number of logical units
+uint32_t ftl_capacity();
+
+// function to start an empty FTL
+// .. num_logical_units of 0 takes the largest capacity the over-provisioning allows
+// .. the sequence numbers carry on from the ones already on the device, so old pages are never replayed
+bool ftl_format(uint32_t num_logical_units);
+
+// function to start the FTL from the newest checkpoint and the pages written after it
+bool ftl_mount();
+
+// function to write one unit, data has FTL_UNIT_SIZE bytes
+bool ftl_write(uint32_t lpn, uint8_t* data);
+
+// function to read one unit, a unit never written reads as 0xff
+// .. only the unit and its parity are clocked out of the page (vectored read)
+// .. returns false for an uncorrectable unit, also after garbage collection found it so and dropped it
+bool ftl_read(uint32_t lpn, uint8_t* data);
+
+// function to program the partly filled page and write a checkpoint
+bool ftl_sync();
+
+// function to run one garbage collection, returns false if there was no block worth collecting
+bool ftl_collect();
+
+#endif
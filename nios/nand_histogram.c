@@ -0,0 +1,213 @@
+#include "nand_histogram.h"
+
+latency_histogram histograms[HISTOGRAM_OPS];
+latency_summary* histogram_by_page[HISTOGRAM_OPS] = {NULL};
+latency_summary* histogram_by_block[HISTOGRAM_OPS] = {NULL};
+
+const char* histogram_op_names[HISTOGRAM_OPS] = {"none","read","program","erase"};
+
+uint32_t histogram_bucket_low(uint8_t bucket)
+{
+	if(bucket<4)
+	{
+		return bucket;
+	}
+	return (uint32_t)(4+(bucket&3))<<(bucket/4-1);
+}
+
+uint32_t histogram_bucket_high(uint8_t bucket)
+{
+	return (bucket+1<HISTOGRAM_BUCKETS)?histogram_bucket_low(bucket+1)-1:0xffffffff;
+}
+
+void histogram_summary_add(latency_summary* summary, uint32_t cycles)
+{
+	if(!summary->count || cycles<summary->min)
+	{
+		summary->min = cycles;
+	}
+	if(cycles>summary->max)
+	{
+		summary->max = cycles;
+	}
+	summary->count++;
+	summary->sum += cycles;
+}
+
+bool histogram_init(bool by_page, bool by_block)
+{
+	uint32_t num_pages = by_page?device_geometry.pages_per_block:0;
+	uint32_t num_blocks = by_block?device_geometry.num_luns*device_geometry.blocks_per_lun:0;
+
+	memset(histograms,0,sizeof(histograms));
+	for(uint8_t op=0;op<HISTOGRAM_OPS;op++)
+	{
+		free(histogram_by_page[op]);
+		free(histogram_by_block[op]);
+		histogram_by_page[op] = NULL;
+		histogram_by_block[op] = NULL;
+		if(op==NAND_OP_NONE)
+		{
+			continue;
+		}
+		// an erase has no page in block
+		if(num_pages && op!=NAND_OP_ERASE)
+		{
+			histogram_by_page[op] = (latency_summary*)calloc(num_pages,sizeof(latency_summary));
+			if(!histogram_by_page[op])
+			{
+				printf("Not enough memory for the latencies per page\n");
+				return false;
+			}
+		}
+		if(num_blocks)
+		{
+			histogram_by_block[op] = (latency_summary*)calloc(num_blocks,sizeof(latency_summary));
+			if(!histogram_by_block[op])
+			{
+				printf("Not enough memory for the latencies per block\n");
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+void histogram_record(uint8_t op, uint8_t* row_address, uint32_t cycles)
+{
+	if(op==NAND_OP_NONE || op>=HISTOGRAM_OPS)
+	{
+		return;
+	}
+
+	latency_histogram* histogram = &histograms[op];
+	if(!histogram->count || cycles<histogram->min)
+	{
+		histogram->min = cycles;
+	}
+	if(cycles>histogram->max)
+	{
+		histogram->max = cycles;
+	}
+	histogram->count++;
+	histogram->sum += cycles;
+	histogram->buckets[histogram_bucket(cycles)]++;
+
+	if(histogram_by_page[op] || histogram_by_block[op])
+	{
+		uint8_t lun;
+		uint32_t block,page;
+
+		split_row_address(row_address,&lun,&block,&page);
+		if(histogram_by_page[op])
+		{
+			histogram_summary_add(&histogram_by_page[op][page],cycles);
+		}
+		if(histogram_by_block[op])
+		{
+			histogram_summary_add(&histogram_by_block[op][lun*device_geometry.blocks_per_lun+block],cycles);
+		}
+	}
+}
+
+uint32_t histogram_mean(uint8_t op)
+{
+	latency_histogram* histogram = &histograms[op];
+	return histogram->count?(uint32_t)(histogram->sum/histogram->count):0;
+}
+
+uint32_t histogram_percentile(uint8_t op, uint8_t percent)
+{
+	latency_histogram* histogram = &histograms[op];
+	if(!histogram->count)
+	{
+		return 0;
+	}
+
+	// rank of the operation asked for, 1 to count
+	uint32_t rank = ((uint64_t)histogram->count*percent+99)/100;
+	uint32_t seen = 0;
+	if(!rank)
+	{
+		rank = 1;
+	}
+	for(uint8_t bucket=0;bucket<HISTOGRAM_BUCKETS;bucket++)
+	{
+		seen += histogram->buckets[bucket];
+		if(seen>=rank)
+		{
+			uint32_t high = histogram_bucket_high(bucket);
+			return (high<histogram->max)?high:histogram->max;
+		}
+	}
+	return histogram->max;
+}
+
+void histogram_summaries_csv(uint8_t op, const char* key_name, latency_summary* summaries, uint32_t num_keys)
+{
+	for(uint32_t key=0;key<num_keys;key++)
+	{
+		latency_summary* summary = &summaries[key];
+		if(summary->count)
+		{
+			printf("%s,%s,%lu,%lu,%lu,%lu,%lu\n",histogram_op_names[op],key_name,(unsigned long)key,(unsigned long)summary->count,(unsigned long)summary->min,(unsigned long)summary->max,
+				(unsigned long)(summary->sum/summary->count));
+		}
+	}
+}
+
+void histogram_export_csv()
+{
+	printf("op,low,high,count\n");
+	for(uint8_t op=NAND_OP_READ;op<HISTOGRAM_OPS;op++)
+	{
+		for(uint8_t bucket=0;bucket<HISTOGRAM_BUCKETS;bucket++)
+		{
+			if(histograms[op].buckets[bucket])
+			{
+				printf("%s,%lu,%lu,%lu\n",histogram_op_names[op],(unsigned long)histogram_bucket_low(bucket),(unsigned long)histogram_bucket_high(bucket),
+					(unsigned long)histograms[op].buckets[bucket]);
+			}
+		}
+	}
+
+	printf("op,count,min,max,mean,p50,p99\n");
+	for(uint8_t op=NAND_OP_READ;op<HISTOGRAM_OPS;op++)
+	{
+		printf("%s,%lu,%lu,%lu,%lu,%lu,%lu\n",histogram_op_names[op],(unsigned long)histograms[op].count,(unsigned long)histograms[op].min,(unsigned long)histograms[op].max,
+			(unsigned long)histogram_mean(op),(unsigned long)histogram_percentile(op,50),(unsigned long)histogram_percentile(op,99));
+	}
+
+	bool keyed = false;
+	for(uint8_t op=NAND_OP_READ;op<HISTOGRAM_OPS;op++)
+	{
+		keyed |= histogram_by_page[op] || histogram_by_block[op];
+	}
+	if(!keyed)
+	{
+		return;
+	}
+	printf("op,key,index,count,min,max,mean\n");
+	for(uint8_t op=NAND_OP_READ;op<HISTOGRAM_OPS;op++)
+	{
+		if(histogram_by_page[op])
+		{
+			histogram_summaries_csv(op,"page",histogram_by_page[op],device_geometry.pages_per_block);
+		}
+		if(histogram_by_block[op])
+		{
+			histogram_summaries_csv(op,"block",histogram_by_block[op],device_geometry.num_luns*device_geometry.blocks_per_lun);
+		}
+	}
+}
+
+uint32_t histogram_export(uint8_t* buffer, uint32_t size)
+{
+	uint32_t length = sizeof(latency_histogram)*(HISTOGRAM_OPS-NAND_OP_READ);
+	if(size<length)
+	{
+		return 0;
+	}
+	memcpy(buffer,&histograms[NAND_OP_READ],length);
+	return length;
+}
@@ -0,0 +1,84 @@
+/*
+File: nand_histogram.h
+Description: Latency histograms of the array operations (tR, tPROG, tBERS)
+			.. fed by trace_end() with the cycles from the confirm command to the end of the R/B# wait
+			.. .. so they are only filled with TIMER_PROFILE, each update is a few instructions
+			.. log buckets, 4 per power of two (values below 4 have their own bucket), so 25% wide at most
+			.. .. a percentile is the top of the bucket it falls in, never more than the largest value seen
+			.. optionally a count/min/max/mean summary per page in block (lower/upper MLC pages)
+			.. .. and per block (slow or worn blocks), see histogram_init()
+			.. Each of the functions declared here are defined in file nand_histogram.c
+*/
+#ifndef nand_histogram_h
+#define nand_histogram_h
+
+#include "nand_interface_header.h"
+
+#define HISTOGRAM_BUCKETS 124
+
+// operations with a histogram: NAND_OP_READ, NAND_OP_PROGRAM, NAND_OP_ERASE
+#define HISTOGRAM_OPS (NAND_OP_ERASE+1)
+
+typedef struct
+{
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint64_t sum;
+	uint32_t buckets[HISTOGRAM_BUCKETS];
+}latency_histogram;
+
+typedef struct
+{
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint64_t sum;
+}latency_summary;
+
+extern latency_histogram histograms[HISTOGRAM_OPS];
+// NULL unless asked for in histogram_init()
+extern latency_summary* histogram_by_page[HISTOGRAM_OPS];
+extern latency_summary* histogram_by_block[HISTOGRAM_OPS];
+
+// bucket of a value
+FORCE_INLINE inline uint8_t histogram_bucket(uint32_t cycles)
+{
+	if(cycles<4)
+	{
+		return cycles;
+	}
+	uint8_t exponent = 31-__builtin_clz(cycles);
+	return 4*(exponent-1)+((cycles>>(exponent-2))&3);
+}
+
+// smallest value of a bucket
+uint32_t histogram_bucket_low(uint8_t bucket);
+
+// largest value of a bucket
+uint32_t histogram_bucket_high(uint8_t bucket);
+
+// function to empty the histograms
+// .. by_page and by_block allocate the summaries per page in block and per block
+bool histogram_init(bool by_page, bool by_block);
+
+// function to add one operation, called from trace_end()
+void histogram_record(uint8_t op, uint8_t* row_address, uint32_t cycles);
+
+// mean of the operation in cycles, 0 if there is none
+uint32_t histogram_mean(uint8_t op);
+
+// value below which percent % of the operations are, in cycles
+uint32_t histogram_percentile(uint8_t op, uint8_t percent);
+
+// function to print the histograms as CSV: op,low,high,count for each bucket in use
+// .. then a line op,count,min,max,mean,p50,p99 for each operation
+// .. and the summaries per page and per block (op,page|block,key,count,min,max,mean) if they were asked for
+void histogram_export_csv();
+
+// function to copy the histograms of all operations to buffer (binary export)
+// .. the latency_histogram of NAND_OP_READ, NAND_OP_PROGRAM then NAND_OP_ERASE, as they are in memory
+// .. returns the number of bytes, 0 if size is too small
+uint32_t histogram_export(uint8_t* buffer, uint32_t size);
+
+#endif
@@ -1,4 +1,5 @@
 #include "nand_interface_header.h"
+#include "nand_trace.h"
 
 // put the user defined header codes here
 // .. all the operations here are asynchronous
@@ -8,6 +9,26 @@ volatile uint32_t* jumper_address =  JUMPER_LOCATION;
 volatile uint32_t* jumper_direction =  JUMPER_DIRECTION;
 volatile uint32_t* push_button = PUSH_KEY_LOCATION;
 
+// software copies of the data and direction registers of the parallel port
+// .. see port_write() and port_direction_write()
+uint32_t port_shadow = 0;
+uint32_t port_direction_shadow = 0;
+
+#if PORT_PROFILE
+port_access_count port_counter = {0,0};
+
+void port_counter_reset()
+{
+	port_counter.loads = 0;
+	port_counter.stores = 0;
+}
+
+void port_counter_report(const char* operation_name)
+{
+	printf("%s: %lu port loads, %lu port stores\n",operation_name,(unsigned long)port_counter.loads,(unsigned long)port_counter.stores);
+}
+#endif
+
 void check_status()
 {	
 	send_command(0x70);
@@ -27,11 +48,17 @@ void check_status()
 FORCE_INLINE inline void set_pin_direction_inactive()
 {
 	// set the required pins as output from the angle of NIOS machine
-	*jumper_direction |= (DQ_mask+CLE_mask+ALE_mask+WP_mask+RE_mask+WE_mask+CE_mask);	// this line just sets the output pins
-	*jumper_direction &= ~(RB_mask);	//this line does it for input pin R/B
+	// .. and R/B# as input
+	// .. this is the only place where the direction register is read, to pick up the other pins of the port
+#if HOST_SIMULATION
+	uint32_t direction = 0;
+#else
+	uint32_t direction = *jumper_direction;
+#endif
+	port_direction_write((direction|OUTPUT_PINS_mask)&~(RB_mask));
 	
 	// let us first reset the DQ pints
-	*jumper_address &= ~(DQ_mask);
+	port_write(port_shadow & ~(DQ_mask));
 }
 
 //function that sets the data lines as input
@@ -40,7 +67,7 @@ FORCE_INLINE inline void set_pin_direction_inactive()
 FORCE_INLINE inline void set_datalines_direction_input()
 {
 	//. set the datalines as input
-	*jumper_direction &= ~(DQ_mask);
+	port_direction_write(port_direction_shadow & ~(DQ_mask));
 }
 
 //function that sets the data lines as output/default
@@ -48,10 +75,10 @@ FORCE_INLINE inline void set_datalines_direction_input()
 // ... this function must be called once the datalines are set as input
 FORCE_INLINE inline void set_datalines_direction_default()
 {
-	//. set the datalines as input
-	*jumper_direction |= (DQ_mask);
+	//. set the datalines as output
+	port_direction_write(port_direction_shadow | DQ_mask);
 	// let us reset the DQ pints
-	*jumper_address &= ~(DQ_mask);
+	port_write(port_shadow & ~(DQ_mask));
 }
 
 //function that resets the values of the outputs pin values
@@ -59,53 +86,39 @@ FORCE_INLINE inline void set_datalines_direction_default()
 // .. operations
 FORCE_INLINE inline void set_default_pin_values()
 {
-	// we do not touch the DQ pin values here
 	// .. since CE#, RE# and WE# are active low, we will set them to 1
 	// .. since ALE and CLE are active high, we will reset them to 0
-	// .. 
-	*jumper_address |= (CE_mask+RE_mask+WE_mask);
-	*jumper_address &= ~(ALE_mask+CLE_mask+DQ_mask);
+	// .. DQ are reset as well
+	port_write(port_idle_value());
 }
 
 // function to send an arbitrary command signal to the NAND device
 // .. the procedure is as follows ( in the sequence )
 FORCE_INLINE inline void send_command(uint8_t command_to_send)
 {
+	uint32_t idle = port_idle_value();
+
 	// .. Write Enable should go low WE => low
-	// .. reset the bit that is connected to WE
-	*jumper_address &= ~(WE_mask);
-	// .. .. Chip Enable should go low CE => low
-	*jumper_address &= ~(CE_mask);
-	// .. .. ALE should go low ALE => low
-	// .. .. ALE should be zero from before
-	// .. ..RE goes high
-	// .. ..RE should be high from before
-	// .. .. CLE should go high CLE => high
-	*jumper_address |= (CLE_mask);
-
-	// .. .. send the command signal in the DQ pins	
-	// .. .. the idea is clear the least 8-bits
-	// .. .. copy the values to be sent
-	// .. .. ..the first part reset the DQ pins
-	// .. .. ..the second part has the actual command to send
-	*jumper_address = (*jumper_address&(~DQ_mask))|(command_to_send & DQ_mask);
+	// .. Chip Enable should go low CE => low
+	// .. ALE should be low, RE# should be high (both from idle)
+	// .. CLE should go high CLE => high
+	// .. and the command is put on the DQ pins
+	// .. .. all of these is a single store, the command is latched on rising edge of WE#
+	port_write((idle&~(WE_mask|CE_mask))|CLE_mask|(command_to_send & DQ_mask));
 
 	//insert delay here
-	// .. tDS = 40 ns
-	SAMPLE_TIME;
+	// .. CE# and CLE went in the same store: tCS and tCLS as well as tDS
+	tCS;
 
 	// disable write enable again
-	*jumper_address |= (WE_mask);
+	port_write((idle&~(CE_mask))|CLE_mask|(command_to_send & DQ_mask));
 
 	//insert delay here
 	// .. because the command is written on the rising edge of WE
 	// tDH = 20 ns
-	// HOLD_TIME;
-	asm("nop");
+	tDH;
 
-	// disable CLE
-	*jumper_address &= ~(CLE_mask);
-	//make sure to call set_default_pin_values()
+	// disable CLE and go back to default pin values
 	set_default_pin_values();
 }
 
@@ -117,38 +130,38 @@ FORCE_INLINE inline void send_addresses(uint8_t* address_to_send, uint8_t num_ad
 	printf("Sending Address: ");
 #endif
 
-	// .. .. CE goes low
-	*jumper_address &= ~CE_mask;
-	// .. CLE goes low
+	// .. CE goes low
 	// .. CLE should be 0 from before
 	// .. ALE goes high
-	*jumper_address |= ALE_mask;
-	// .. RE goes high
 	// .. RE should be high from before
+	uint32_t address_cycle = (port_idle_value()&~(CE_mask))|ALE_mask;
 	
 	for(uint8_t i=0;i<num_address_bytes;i++)
 	{
-		*jumper_address &= ~(WE_mask);
-
-		// .. Put data on the DQ pin
-		// .. .. the idea is clear the least 8-bits
-		// .. .. copy the values to be sent
-		*jumper_address = (*jumper_address&(~DQ_mask))|(address_to_send[i] & DQ_mask);
+		// .. WE# low and the address byte on the DQ pins in one store
+		port_write((address_cycle&~(WE_mask))|(address_to_send[i] & DQ_mask));
 #if DEBUG
-		printf("0x%x,", (uint8_t)*jumper_address&0xff);
+		printf("0x%x,", address_to_send[i]);
 #endif
 		//.. a simple delay
-		SAMPLE_TIME; //tDS
+		// .. the first cycle also lowered CE# and raised ALE: tCS and tALS as well
+		if(i==0)
+		{
+			tCS;
+		}else
+		{
+			tDS;
+		}
 
 		// .. Address is loaded from DQ on rising edge of WE
-		*jumper_address |= WE_mask;
+		port_write(address_cycle|(address_to_send[i] & DQ_mask));
 		// .. maintain WE high for certain duration and make it low
 		
 		// .. put next address bits on DQ and cause rising edge of WE
 		// .. address expected is 5-bytes ColAdd1, ColAdd2, RowAdd1, RowAdd2, RowAdd3
 		
 		//insert delay here
-		asm("nop");	// tDH
+		tDH;
 	}
 	//make sure to call set_default_pin_values()
 	set_default_pin_values();
@@ -162,78 +175,173 @@ FORCE_INLINE inline void send_addresses(uint8_t* address_to_send, uint8_t num_ad
 // .. the procedure is as follows (in the sequence)
 FORCE_INLINE inline void send_address(uint8_t address_to_send)
 {
-#if DEBUG
-	printf("Sending Address: ");
-#endif
+	send_addresses(&address_to_send,1);
+}
 
-	// .. .. CE goes low
-	*jumper_address &= ~CE_mask;
-	// .. CLE goes low
-	// .. CLE should be 0 from before
-	// .. ALE goes high
-	*jumper_address |= ALE_mask;
-	// .. RE goes high
-	// .. RE should be high from before
-	
-	*jumper_address &= ~(WE_mask);
+// lookup table for the data-in cycles, see build_bus_write_lut()
+// .. bus_write_lut_wp is the WP# value the table was built with (or ~0 if it was never built)
+uint32_t bus_write_lut[256][2];
+uint32_t bus_write_lut_wp = ~0;
 
-	// .. Put data on the DQ pin
-	// .. .. the idea is clear the least 8-bits
-	// .. .. copy the values to be sent
-	*jumper_address = (*jumper_address&(~DQ_mask))|(address_to_send & DQ_mask);
-#if DEBUG
-	printf("0x%x,", (uint8_t)*jumper_address&0xff);
-#endif
-	//.. a simple delay
-	SAMPLE_TIME; //tDS
+void build_bus_write_lut()
+{
+	// .. CE# low, ALE and CLE low, RE# high, WP# as it is now
+	uint32_t data_cycle = (port_shadow & WP_mask)|RE_mask|WE_mask;
 
-	// .. Address is loaded from DQ on rising edge of WE
-	*jumper_address |= WE_mask;
-	// .. maintain WE high for certain duration and make it low
-	
-	// .. put next address bits on DQ and cause rising edge of WE
-	// .. address expected is 5-bytes ColAdd1, ColAdd2, RowAdd1, RowAdd2, RowAdd3
-	
-	//insert delay here
-	asm("nop");	// tDH
+	for(uint16_t value=0;value<256;value++)
+	{
+		uint32_t dq = (value<<DQ_shift)&DQ_mask;
+		bus_write_lut[value][0] = (data_cycle&~(WE_mask))|dq;
+		bus_write_lut[value][1] = data_cycle|dq;
+	}
+	bus_write_lut_wp = port_shadow & WP_mask;
+}
 
-	//make sure to call set_default_pin_values()
-	set_default_pin_values();
+// one data-in cycle from the lookup table
+// .. WE# low with data on DQ, wait for tDS, WE# high to latch, wait for tDH
+#define SEND_DATA_BYTE(value) {\
+								const uint32_t* words = bus_write_lut[(value)];\
+								port_store(words[0]);\
+								tDS;\
+								port_store(words[1]);\
+								tDH;\
+							}
+
+#define SEND_DATA_8(pointer) {\
+								SEND_DATA_BYTE((pointer)[0]);\
+								SEND_DATA_BYTE((pointer)[1]);\
+								SEND_DATA_BYTE((pointer)[2]);\
+								SEND_DATA_BYTE((pointer)[3]);\
+								SEND_DATA_BYTE((pointer)[4]);\
+								SEND_DATA_BYTE((pointer)[5]);\
+								SEND_DATA_BYTE((pointer)[6]);\
+								SEND_DATA_BYTE((pointer)[7]);\
+							}
+
+// one data-out cycle with the precomputed re_low/re_high words
+// .. RE# low, wait for tREA, sample DQ, RE# high, wait for tREH
+#define GET_DATA_BYTE(destination) {\
+									port_store(re_low);\
+									tREA;\
+									(destination) = (port_read() & DQ_mask)>>DQ_shift;\
+									port_store(re_high);\
+									tREH;\
+								}
+
+#define GET_DATA_8(pointer) {\
+								GET_DATA_BYTE((pointer)[0]);\
+								GET_DATA_BYTE((pointer)[1]);\
+								GET_DATA_BYTE((pointer)[2]);\
+								GET_DATA_BYTE((pointer)[3]);\
+								GET_DATA_BYTE((pointer)[4]);\
+								GET_DATA_BYTE((pointer)[5]);\
+								GET_DATA_BYTE((pointer)[6]);\
+								GET_DATA_BYTE((pointer)[7]);\
+							}
+
+// streaming loop for data-in
+// .. blocks of 16 bytes, then one block of 8 and the remaining bytes
+// .. when num_data is a constant the trip count and the tail are resolved at compile time
+FORCE_INLINE static inline void send_data_stream(uint8_t* data_to_send,const uint16_t num_data)
+{
+	uint8_t* blocks_end = data_to_send+(num_data&~0xf);
 
-#if DEBUG
-	printf("\n");
-#endif
+	while(data_to_send<blocks_end)
+	{
+		SEND_DATA_8(data_to_send);
+		SEND_DATA_8(data_to_send+8);
+		data_to_send += 16;
+	}
+	if(num_data&0x8)
+	{
+		SEND_DATA_8(data_to_send);
+		data_to_send += 8;
+	}
+	for(uint8_t i=0;i<(num_data&0x7);i++)
+	{
+		SEND_DATA_BYTE(data_to_send[i]);
+	}
+}
+
+// streaming loop for data-out, same layout as send_data_stream()
+FORCE_INLINE static inline void get_data_stream(uint8_t* data_received,const uint16_t num_data,uint32_t re_low,uint32_t re_high)
+{
+	uint8_t* blocks_end = data_received+(num_data&~0xf);
+
+	while(data_received<blocks_end)
+	{
+		GET_DATA_8(data_received);
+		GET_DATA_8(data_received+8);
+		data_received += 16;
+	}
+	if(num_data&0x8)
+	{
+		GET_DATA_8(data_received);
+		data_received += 8;
+	}
+	for(uint8_t i=0;i<(num_data&0x7);i++)
+	{
+		GET_DATA_BYTE(data_received[i]);
+	}
 }
 
+// following generates the size specialized transfer kernels
+// .. send_data_<size>() and get_data_<size>() have a constant trip count
+// .. send_data() and get_data() dispatch to them when num_data matches
+// .. the size is expanded first so that the TRANSFER_SIZE_* macros give the numeric names
+#define DEFINE_TRANSFER_KERNELS(size) DEFINE_TRANSFER_KERNELS_EXPANDED(size)
+#define DEFINE_TRANSFER_KERNELS_EXPANDED(size) \
+	void send_data_##size(uint8_t* data_to_send)\
+	{\
+		send_data_stream(data_to_send,size);\
+	}\
+	void get_data_##size(uint8_t* data_received,uint32_t re_low,uint32_t re_high)\
+	{\
+		get_data_stream(data_received,size,re_low,re_high);\
+	}
+
+DEFINE_TRANSFER_KERNELS(TRANSFER_SIZE_PAGE)
+DEFINE_TRANSFER_KERNELS(TRANSFER_SIZE_PAGE_SPARE)
+DEFINE_TRANSFER_KERNELS(TRANSFER_SIZE_SPARE)
+DEFINE_TRANSFER_KERNELS(TRANSFER_SIZE_CODEWORD_512)
+DEFINE_TRANSFER_KERNELS(TRANSFER_SIZE_CODEWORD_1024)
+
 // function to send data from the host machine to the NAND flash
 // .. Data is written from DQ[7:0] to the cache register of the selected die (LUN)
 // .. .. on the rising edge of WE# when CE# is LOW, ALE is LOW, CLE is LOW, and RE# is HIGH
+// .. each byte is exactly two stores taken from bus_write_lut
 FORCE_INLINE inline void send_data(uint8_t* data_to_send,uint16_t num_data)
 {
-	// .. CE should be low
-	*jumper_address &= ~CE_mask;
-
-	for(uint16_t i=0;i<num_data;i++)
+	// make sure the table matches the current WP# value
+	if((port_shadow & WP_mask)!=bus_write_lut_wp)
 	{
-		// .. make WE low and repeat the procedure again for number of bytes required (int num_data)
-		*jumper_address &= ~WE_mask;
-
-		// .. put data on DQ and latch WE high for certain duration
-		// .. .. the idea is clear the least 8-bits
-		// .. .. copy the values to be sent
-		*jumper_address = (*jumper_address&(~DQ_mask))|(data_to_send[i] & DQ_mask);
-		//.. a simple delay
-		SAMPLE_TIME;	// tDS
-
-		*jumper_address |= WE_mask;
+		build_bus_write_lut();
+	}
 
-		//insert delay here
-		// HOLD_TIME;	//tDH
-		asm("nop");
+	// CE# low on its own first, the first data cycle then only needs tDS
+	port_store(bus_write_lut[0][1]&~(DQ_mask));
+	tCS;
 
-		// reset all the data on DQ pins
-		// .. this might be unnecesary
-		*jumper_address &= ~(DQ_mask);		
+	switch(num_data)
+	{
+		case TRANSFER_SIZE_PAGE:
+			send_data_8192(data_to_send);
+			break;
+		case TRANSFER_SIZE_PAGE_SPARE:
+			send_data_8936(data_to_send);
+			break;
+		case TRANSFER_SIZE_SPARE:
+			send_data_744(data_to_send);
+			break;
+		case TRANSFER_SIZE_CODEWORD_512:
+			send_data_512(data_to_send);
+			break;
+		case TRANSFER_SIZE_CODEWORD_1024:
+			send_data_1024(data_to_send);
+			break;
+		default:
+			send_data_stream(data_to_send,num_data);
+			break;
 	}
 	//make sure to call set_default_pin_values()
 	set_default_pin_values();
@@ -244,44 +352,60 @@ FORCE_INLINE inline void send_data(uint8_t* data_to_send,uint16_t num_data)
 // .. it is supported following a read operation of NAND array
 void get_data(uint8_t* data_received,uint16_t num_data)
 {
-	set_datalines_direction_input();
-
 	// .. data can be received when on ready state (RDY signal)
 	// .. ensure RDY is high
 	// .. .. just keep spinning here checking for ready signal
-	while((*jumper_address & RB_mask)== 0x00);
+	wait_ready();
+
+	get_data_while_busy(data_received,num_data);
+}
+
+// function to receive data without looking at R/B#
+// .. R/B# is shared by all the LUNs, so this is needed to read the status
+// .. .. or the cache register of one LUN while another one is busy
+void get_data_while_busy(uint8_t* data_received,uint16_t num_data)
+{
+	set_datalines_direction_input();
 
 	// .. data can be received following READ operation
 	// .. the procedure should be as follows
 	// .. .. CE should be low
-	*jumper_address &= ~CE_mask;
-	// .. make WE high
-	// .. .. WE should be high from before
-	// .. .. ALE and CLE should be low
-	// .. .. they should be low from before
-
-	for(uint16_t i=0;i<num_data;i++)
-	{			
-		// set the RE to low for next cycle
-		*jumper_address &= ~RE_mask;
-
-		// tREA = 40ns
-		SAMPLE_TIME;
+	// .. .. WE should be high, ALE and CLE should be low (all from before)
+	uint32_t re_high = port_idle_value()&~(CE_mask);
+	uint32_t re_low = re_high&~(RE_mask);
 
-		// read the data
-		data_received[i] = *jumper_address & DQ_mask;
-
-		// .. data is available at DQ pins on the rising edge of RE pin (RE is also input to NAND)
-		*jumper_address |= RE_mask;
-		
-		// tREH
-		asm("nop"); // same same 
+	switch(num_data)
+	{
+		case TRANSFER_SIZE_PAGE:
+			get_data_8192(data_received,re_low,re_high);
+			break;
+		case TRANSFER_SIZE_PAGE_SPARE:
+			get_data_8936(data_received,re_low,re_high);
+			break;
+		case TRANSFER_SIZE_SPARE:
+			get_data_744(data_received,re_low,re_high);
+			break;
+		case TRANSFER_SIZE_CODEWORD_512:
+			get_data_512(data_received,re_low,re_high);
+			break;
+		case TRANSFER_SIZE_CODEWORD_1024:
+			get_data_1024(data_received,re_low,re_high);
+			break;
+		default:
+			get_data_stream(data_received,num_data,re_low,re_high);
+			break;
 	}
+	// .. the last store left CE# low with RE# high
+	port_shadow = re_high;
 
 	// set the pins as output
-	set_datalines_direction_default();
+	// .. set_default_pin_values() below also resets the DQ pins
+	port_direction_write(port_direction_shadow | DQ_mask);
 	//make sure to call set_default_pin_values()
 	set_default_pin_values();
+
+	// the next command (WE# low) may only come tRHW after the last RE# high
+	tRHW;
 }
 
 
@@ -293,47 +417,41 @@ void get_data_fast(uint8_t* data_received,uint16_t num_data)
 {
 	// set the DQ pins as IP to the NIOS processor
 	// .. 0 is IP and 1 is OP
-	*jumper_direction &= ~0x40ff;
+	port_direction_write(port_direction_shadow & ~(DQ_mask|RB_mask));
 
 	// .. data can be received when on ready state (RDY signal)
 	// .. ensure RDY is high
 	// .. .. just keep spinning here checking for ready signal
-	while((*jumper_address & RB_mask)== 0x00);
+	wait_ready();
 
 	// .. data can be received following READ operation
 	// .. the procedure should be as follows
 	// .. .. CE should be low
-	*jumper_address &= ~CE_mask;
 	// .. make WE high
-	*jumper_address |= WE_mask;
 	// .. .. ALE and CLE should be low
-	*jumper_address &= ~ALE_mask;
-	*jumper_address &= ~CLE_mask;
-
-	// set the RE to low for next cycle
-	// .. we will ignore the falling edge here
-	// *jumper_address &= ~RE_mask;
-	// *jumper_address |= RE_mask;
+	uint32_t re_high = ((port_shadow|WE_mask)&~(CE_mask|ALE_mask|CLE_mask));
+	uint32_t re_low = re_high&~(RE_mask);
+	port_write(re_high);
 
 	for(uint16_t i=0;i<num_data;i++)
 	{			
 		// set the RE to low for next cycle
-		*jumper_address &= ~RE_mask;
+		port_write(re_low);
 
 		// read the data
-		data_received[i] = *jumper_address & DQ_mask;
+		data_received[i] = port_read() & DQ_mask;
 
 		// // tRP = default delay
 
 		// .. data is available at DQ pins on the rising edge of RE pin (RE is also input to NAND)
-		*jumper_address |= RE_mask;
+		port_write(re_high);
 		
 		//insert delay here
 		// .. tREH =  default delay here
 	}
 
 	// set the pins as output
-	*jumper_direction |= 0x03fff;	
+	port_direction_write(port_direction_shadow | (OUTPUT_PINS_mask));
 }
 
 // function to disable Program and Erase operation
@@ -343,10 +461,10 @@ void write_protect()
 {
 	// check to see if the device is busy
 	// .. wait if busy
-	while((*jumper_address&RB_mask)==0x00);
+	wait_ready();
 
 	// wp to low
-	*jumper_address &= ~WP_mask;	
+	port_write(port_shadow & ~(WP_mask));
 	
 	//insert delay here
 	for(uint8_t i=0;i<4;i++);
@@ -356,15 +474,16 @@ void write_enable()
 {
 	// check to see if the device is busy
 	// .. wait if busy
-	while((*jumper_address&RB_mask)==0x00);
+	wait_ready();
 
 	// wp to high
-	*jumper_address |= WP_mask;
+	port_write(port_shadow | WP_mask);
 	
 	//insert delay here
 	tWW;
 }
 
+
 // function to disable Program operation
 // .. when WP is low, program and erase operation are disabled
 // .. when WP is high, program and erase operation are enabled
@@ -390,6 +509,133 @@ void enable_erase()
 	write_enable();
 }
 
+// waits for timing mode 0 at CPU_CLOCK_MHZ until timing_configure() is called
+nand_timing_cycles nand_timing =
+{
+	.mode = 0,
+	.ds = WAIT_CYCLES(TIMING_MAX(ONFI_tDS_ns(0),ONFI_tWP_ns(0))),
+	.cs = WAIT_CYCLES(ONFI_FIRST_LATCH_ns(0)),
+	.dh = WAIT_CYCLES(TIMING_MAX(ONFI_tDH_ns(0),ONFI_tWH_ns(0))),
+	.rea = WAIT_CYCLES(TIMING_MAX(ONFI_tREA_ns(0),ONFI_tRP_ns(0))),
+	.reh = WAIT_CYCLES(ONFI_tREH_ns(0)),
+	.wb = WAIT_CYCLES(ONFI_tWB_ns(0)),
+	.whr = WAIT_CYCLES(ONFI_tWHR_ns(0)),
+	.rr = WAIT_CYCLES(ONFI_tRR_ns(0)),
+	.adl = WAIT_CYCLES(ONFI_tADL_ns(0)),
+	.ccs = WAIT_CYCLES(ONFI_tCCS_ns),
+	.rhw = WAIT_CYCLES(ONFI_tRHW_ns(0)),
+	.ww = WAIT_CYCLES(ONFI_tWW_ns),
+};
+
+// turns a time in ns in to the wait cycles at the given clock
+uint16_t timing_wait_cycles(uint16_t time_ns, uint16_t cpu_mhz)
+{
+	uint32_t cycles = ((uint32_t)time_ns*cpu_mhz+999)/1000;
+	return cycles>PORT_ACCESS_CYCLES?cycles-PORT_ACCESS_CYCLES:0;
+}
+
+void timing_configure(uint8_t mode, uint16_t cpu_mhz)
+{
+	if(mode>5)
+	{
+		mode = 5;
+	}
+	nand_timing.mode = mode;
+	nand_timing.ds = timing_wait_cycles(TIMING_MAX(ONFI_tDS_ns(mode),ONFI_tWP_ns(mode)),cpu_mhz);
+	nand_timing.cs = timing_wait_cycles(ONFI_FIRST_LATCH_ns(mode),cpu_mhz);
+	nand_timing.dh = timing_wait_cycles(TIMING_MAX(ONFI_tDH_ns(mode),ONFI_tWH_ns(mode)),cpu_mhz);
+	nand_timing.rea = timing_wait_cycles(TIMING_MAX(ONFI_tREA_ns(mode),ONFI_tRP_ns(mode)),cpu_mhz);
+	nand_timing.reh = timing_wait_cycles(ONFI_tREH_ns(mode),cpu_mhz);
+	nand_timing.wb = timing_wait_cycles(ONFI_tWB_ns(mode),cpu_mhz);
+	nand_timing.whr = timing_wait_cycles(ONFI_tWHR_ns(mode),cpu_mhz);
+	nand_timing.rr = timing_wait_cycles(ONFI_tRR_ns(mode),cpu_mhz);
+	nand_timing.adl = timing_wait_cycles(ONFI_tADL_ns(mode),cpu_mhz);
+	nand_timing.ccs = timing_wait_cycles(device_geometry.t_ccs_ns?device_geometry.t_ccs_ns:ONFI_tCCS_ns,cpu_mhz);
+	nand_timing.rhw = timing_wait_cycles(ONFI_tRHW_ns(mode),cpu_mhz);
+	nand_timing.ww = timing_wait_cycles(ONFI_tWW_ns,cpu_mhz);
+#if DEBUG
+	printf("Timing mode %d: tDS %d, tDH %d, tREA %d, tWB %d, tWHR %d, tRR %d, tADL %d, tCCS %d cycles\n",
+		mode,nand_timing.ds,nand_timing.dh,nand_timing.rea,nand_timing.wb,nand_timing.whr,nand_timing.rr,nand_timing.adl,nand_timing.ccs);
+#endif
+}
+
+// function to write the parameters of a feature
+// .. feature 0x01 is the timing mode
+void set_features(uint8_t feature_address, uint8_t* parameters)
+{
+	// make sure none of the LUNs are busy
+	wait_ready();
+
+	send_command(0xef);
+	send_address(feature_address);
+
+	// tADL before the first parameter
+	tADL;
+
+	send_data(parameters,4);
+
+	tWB;
+	// .. tFEAT
+	wait_ready();
+}
+
+// function to read the parameters of a feature
+void get_features(uint8_t feature_address, uint8_t* parameters)
+{
+	// make sure none of the LUNs are busy
+	wait_ready();
+
+	send_command(0xee);
+	send_address(feature_address);
+
+	tWB;
+	// .. tFEAT
+	wait_ready();
+	tRR;
+
+	get_data(parameters,4);
+}
+
+uint8_t fastest_timing_mode()
+{
+#if NAND_TIMING_MODE!=TIMING_MODE_RUNTIME
+	// .. the waits are built for NAND_TIMING_MODE, it is the only mode we can run
+	return NAND_TIMING_MODE;
+#else
+	uint8_t mode = 0;
+	for(uint8_t i=1;i<=5;i++)
+	{
+		if(device_geometry.timing_modes&(1<<i))
+		{
+			mode = i;
+		}
+	}
+	return mode;
+#endif
+}
+
+bool set_timing_mode(uint8_t mode)
+{
+	// mode 0 is always supported
+	if(mode>5 || (mode>0 && (device_geometry.timing_modes&(1<<mode))==0))
+	{
+		printf("Timing mode %d is not supported by the device\n",mode);
+		return false;
+	}
+
+	// P1 is the timing mode, P2..P4 are reserved
+	uint8_t parameters[4] = {mode,0,0,0};
+	set_features(0x01,parameters);
+
+	timing_configure(mode,CPU_CLOCK_MHZ);
+
+#if DEBUG
+	get_features(0x01,parameters);
+	printf("Timing mode read back from the device: %d\n",parameters[0]);
+#endif
+	return true;
+}
+
 // function to initialize the NAND device
 // .. following are the tasks to be performed for initialization of NAND device
 // .. provide Vcc (ie ramp Vcc)
@@ -406,10 +652,17 @@ void device_initialization()
 	for(uint16_t i=0;i<90;i++);	//50 us max
 
 	// wait for R/B signal to go high
-	while((*jumper_address & RB_mask)==0);
+	wait_ready();
 
 	// now issue RESET command
 	reset_device();
+
+	// pick up the geometry of the device
+	// .. the built-in values of device_geometry are kept if this fails
+	read_parameter_page(&device_geometry);
+
+	// and move to the fastest timing mode both of us can do
+	set_timing_mode(fastest_timing_mode());
 }
 
 // function to reset the whole device
@@ -420,20 +673,8 @@ void device_initialization()
 // .. .. check for R/B signal to be high after certain duration (should go low(busy) and go high (ready))
 void reset_device()
 {
-	// oxff is reset command
-	send_command(0xff);
-	// no address is expected for reset command
-	// wait for busy signal again
-	
-	//insert delay here
-	// .. not needed because the next polling statement will take care
-	// .. polling the Ready/BUSY signal
-	// .. but we should wait for tWB = 200ns before the RB signal is valid
-	tWB;	// tWB = 200ns
-
-	while((*jumper_address & RB_mask)==0);
+	nand_wait(nand_submit_reset());
 }
-
 // following function will reset just a particular LUN
 // .. a LUN or logical unit is also called a NAND flash die (our NAND has 2 planes in a die)
 // .. can be used to put the LUN into a known state or abort commadn sequences going on
@@ -443,13 +684,14 @@ void reset_device()
 void reset_LUN(uint8_t* address_LUN, uint8_t num_address_bytes)
 {
 	// 0xfa is the reset LUN command
+	cache_register_forget_all();
 	send_command(0xfa);
 	// send the address of the LUN to reset
 	send_addresses(address_LUN,num_address_bytes);
 	
 	//insert delay here
 	tWB;//tWB
-	while((*jumper_address & RB_mask)==0);	
+	wait_ready();	
 }
 
 // function to read the device ID
@@ -464,7 +706,7 @@ void reset_LUN(uint8_t* address_LUN, uint8_t num_address_bytes)
 void read_manufacturer_id(uint8_t* device_id_array)
 {
 	// make sure none of the LUNs are busy
-	while((*jumper_address & RB_mask)==0);
+	wait_ready();
 	// read ID command
 	send_command(0x90);
 	// send address 00
@@ -482,69 +724,249 @@ void read_manufacturer_id(uint8_t* device_id_array)
 #endif
 }
 
+// known parts, used by detect_device() when there is no parameter page
+typedef struct
+{
+	uint8_t id[5];
+	const char* name;
+}nand_id_entry;
+
+const nand_id_entry known_devices[] =
+{
+	{{0x2c,0x88,0x04,0x4b,0xa9},"MT29FxxxG08Cxxxx"},
+	{{0x2c,0xa8,0x05,0x5b,0xa9},"MT29FxxxG08Cxxxx"},
+	{{0x2c,0x64,0x44,0x4b,0xa9},"MT29F64G08CBABA"},
+};
+
 // function that reads the device ID and tries to detect the device name
-// .. call the function device_id at address 00h
-// .. lookup table based finding for device name
+// .. the parameter page gives the name if it has been read
+// .. otherwise lookup table based finding for device name
 // .. this function is not decisive
 void detect_device()
 {
+	if(device_geometry.from_parameter_page)
+	{
+		printf("Detected Device ID is %s %s\n", device_geometry.manufacturer, device_geometry.model);
+		return;
+	}
+
 	// create a 8-byte variable
 	// .. static array
 	uint8_t my_device_id[8];
 
 	// following call should return the device ID to the array
 	read_manufacturer_id(my_device_id);
-	char device_name[20] = "?";
-	// now check each bytes
-	if(my_device_id[0]==0x2c)
+
+	for(uint8_t i=0;i<sizeof(known_devices)/sizeof(known_devices[0]);i++)
 	{
-		if(my_device_id[1]==0x88)
+		if(memcmp(my_device_id,known_devices[i].id,5)==0)
 		{
-			if(my_device_id[2]==0x04)
-			{
-				if(my_device_id[3]==0x4b)
-				{					
-					if(my_device_id[4]==0xa9)
-					{
-						strcpy(device_name,"MT29FxxxG08Cxxxx\0");	
-					}
-				}
-			}
-		}else if(my_device_id[1]==0xA8)
+			printf("Detected Device ID is %s\n", known_devices[i].name);
+			return;
+		}
+	}
+	printf("Device Family Not Recognized\n");
+}
+
+// values for MT29F64G08CBABA until the parameter page is read
+nand_geometry device_geometry =
+{
+	.from_parameter_page = false,
+	.manufacturer = "MICRON",
+	.model = "MT29F64G08CBABA",
+	.manufacturer_id = 0x2c,
+	.page_size = 8192,
+	.spare_size = 744,
+	.pages_per_block = 256,
+	.blocks_per_lun = 4096,
+	.num_luns = 1,
+	.num_planes = 2,
+	.column_address_cycles = 2,
+	.row_address_cycles = 3,
+	.bits_per_cell = 2,
+	.timing_modes = 0x01,
+	.t_prog_us = 2300,
+	.t_bers_us = 10000,
+	.t_r_us = 75,
+	.t_ccs_ns = 200,
+	.page_bits = 8,
+	.block_bits = 12,
+};
+
+uint16_t onfi_crc16(uint8_t* data, uint16_t len)
+{
+	uint16_t crc = 0x4f4e;
+	for(uint16_t i=0;i<len;i++)
+	{
+		crc ^= ((uint16_t)data[i])<<8;
+		for(uint8_t bit=0;bit<8;bit++)
 		{
-			if(my_device_id[2]==0x05)
-			{
-				if(my_device_id[3]==0x5b)
-				{
-					if(my_device_id[4]==0xa9)
-					{
-						strcpy(device_name,"MT29FxxxG08Cxxxx\0");	
-					}					
-				}				
-			}
-		}else if(my_device_id[1]==0x64)
+			crc = (crc&0x8000)?((crc<<1)^0x8005):(crc<<1);
+		}
+	}
+	return crc;
+}
+
+// number of bits needed to hold values 0..count-1
+uint8_t bits_for_count(uint32_t count)
+{
+	uint8_t bits = 0;
+	while((1UL<<bits)<count)
+	{
+		bits++;
+	}
+	return bits;
+}
+
+// little endian fields of the parameter page
+uint16_t parameter_u16(uint8_t* page, uint16_t offset)
+{
+	return page[offset]|(page[offset+1]<<8);
+}
+
+uint32_t parameter_u32(uint8_t* page, uint16_t offset)
+{
+	return parameter_u16(page,offset)|((uint32_t)parameter_u16(page,offset+2)<<16);
+}
+
+// copies a space padded string from the parameter page and trims it
+void parameter_string(uint8_t* page, uint16_t offset, uint8_t len, char* destination)
+{
+	memcpy(destination,page+offset,len);
+	destination[len] = '\0';
+	for(int8_t i=len-1;i>=0 && destination[i]==' ';i--)
+	{
+		destination[i] = '\0';
+	}
+}
+
+// function to read the ONFI parameter page
+// .. following is the sequence
+// .. .. command 0xEC, address 0x00
+// .. .. wait for tWB and for R/B# to go high (tR)
+// .. .. 256 bytes per copy are clocked out, copy after copy
+bool read_parameter_page(nand_geometry* geometry)
+{
+	uint8_t page[256];
+
+	// make sure none of the LUNs are busy
+	wait_ready();
+
+	cache_register_forget_all();
+	send_command(0xec);
+	send_address(0x00);
+
+	tWB;
+	wait_ready();
+	tRR;
+
+	// the ONFI specification requires at least three copies
+	uint8_t copy;
+	for(copy=0;copy<3;copy++)
+	{
+		get_data(page,256);
+
+		if(page[0]=='O' && page[1]=='N' && page[2]=='F' && page[3]=='I' && onfi_crc16(page,254)==parameter_u16(page,254))
 		{
-			if(my_device_id[2]==0x44)
-			{
-				if(my_device_id[3]==0x4b)
-				{
-					if(my_device_id[4]==0xa9)
-					{
-						strcpy(device_name,"MT29F64G08CBABA\0");	
-					}					
-				}				
-			}
+			break;
 		}
+#if DEBUG
+		printf("Parameter page copy %d failed the CRC check\n",copy);
+#endif
+	}
+	if(copy==3)
+	{
+		printf("No valid copy of the parameter page\n");
+		return false;
 	}
 
-	if(device_name[0]=='?')
+	// .. the sizes below are trusted by every fixed address buffer and uint16_t transfer length
+	// .. .. so a page that passes the CRC but is out of range leaves the built-in values
+	uint32_t page_size = parameter_u32(page,80);
+	uint16_t spare_size = parameter_u16(page,84);
+	uint32_t pages_per_block = parameter_u32(page,92);
+	uint32_t blocks_per_lun = parameter_u32(page,96);
+	uint8_t row_address_cycles = page[101]&0x0f;
+	uint8_t column_address_cycles = (page[101]>>4)&0x0f;
+	if(row_address_cycles==0 || row_address_cycles>MAX_ROW_ADDRESS_CYCLES
+		|| column_address_cycles==0 || column_address_cycles>MAX_COLUMN_ADDRESS_CYCLES
+		|| page_size==0 || page_size+spare_size>0xffff || page[100]==0
+		|| pages_per_block==0 || pages_per_block>(1UL<<24) || blocks_per_lun==0 || blocks_per_lun>(1UL<<24)
+		|| bits_for_count(pages_per_block)+bits_for_count(blocks_per_lun)+bits_for_count(page[100])>8*row_address_cycles)
 	{
-		printf("Device Family Not Recognized\n");
-	}else
+		printf("Parameter page geometry out of range, the built-in geometry is kept\n");
+		return false;
+	}
+
+	geometry->from_parameter_page = true;
+	parameter_string(page,32,12,geometry->manufacturer);
+	parameter_string(page,44,20,geometry->model);
+	geometry->manufacturer_id = page[64];
+	geometry->page_size = page_size;
+	geometry->spare_size = spare_size;
+	geometry->pages_per_block = pages_per_block;
+	geometry->blocks_per_lun = blocks_per_lun;
+	geometry->num_luns = page[100];
+	geometry->row_address_cycles = row_address_cycles;
+	geometry->column_address_cycles = column_address_cycles;
+	geometry->bits_per_cell = page[102];
+	// .. byte 113 has the number of plane address bits
+	geometry->num_planes = 1<<(page[113]&0x0f);
+	geometry->timing_modes = parameter_u16(page,129);
+	geometry->t_prog_us = parameter_u16(page,133);
+	geometry->t_bers_us = parameter_u16(page,135);
+	geometry->t_r_us = parameter_u16(page,137);
+	geometry->t_ccs_ns = parameter_u16(page,139);
+	geometry->page_bits = bits_for_count(geometry->pages_per_block);
+	geometry->block_bits = bits_for_count(geometry->blocks_per_lun);
+
+#if DEBUG
+	printf("Parameter page (copy %d): %s %s, %u+%u bytes/page, %lu pages/block, %lu blocks/LUN, %u LUNs\n",
+		copy,geometry->manufacturer,geometry->model,geometry->page_size,geometry->spare_size,
+		(unsigned long)geometry->pages_per_block,(unsigned long)geometry->blocks_per_lun,geometry->num_luns);
+#endif
+	return true;
+}
+
+void make_row_address(uint8_t lun, uint32_t block, uint32_t page, uint8_t* row_address)
+{
+	uint32_t row = page|(block<<device_geometry.page_bits)|((uint32_t)lun<<(device_geometry.page_bits+device_geometry.block_bits));
+	for(uint8_t i=0;i<device_geometry.row_address_cycles;i++)
+	{
+		row_address[i] = (row>>(8*i))&0xff;
+	}
+}
+
+void make_page_address(uint8_t lun, uint32_t block, uint32_t page, uint16_t column, uint8_t* address)
+{
+	for(uint8_t i=0;i<device_geometry.column_address_cycles;i++)
+	{
+		address[i] = (column>>(8*i))&0xff;
+	}
+	make_row_address(lun,block,page,address+device_geometry.column_address_cycles);
+}
+
+void split_row_address(uint8_t* row_address, uint8_t* lun, uint32_t* block, uint32_t* page)
+{
+	uint32_t row = 0;
+	for(uint8_t i=0;i<device_geometry.row_address_cycles;i++)
 	{
-		printf("Detected Device ID is %s\n", device_name);
+		row |= ((uint32_t)row_address[i])<<(8*i);
+	}
+	if(page)
+	{
+		*page = row&((1UL<<device_geometry.page_bits)-1);
+	}
+	if(block)
+	{
+		*block = (row>>device_geometry.page_bits)&((1UL<<device_geometry.block_bits)-1);
+	}
+	if(lun)
+	{
+		*lun = row>>(device_geometry.page_bits+device_geometry.block_bits);
 	}
 }
+
 // function to read the 4-byte ONFI code
 // when read from address 00h, it returns 4-byte ONFI code
 // follow the following sequences
@@ -557,7 +979,7 @@ void detect_device()
 void read_ONFI_id(uint8_t* device_id_array)
 {
 	// make sure none of the LUNs are busy
-	while((*jumper_address & RB_mask)==0);
+	wait_ready();
 	// read ID command
 	send_command(0x90);
 	// send address 00
@@ -578,7 +1000,7 @@ void read_ONFI_id(uint8_t* device_id_array)
 void read_JEDEC_id(uint8_t* device_id_array)
 {
 	// make sure none of the LUNs are busy
-	while((*jumper_address & RB_mask)==0);
+	wait_ready();
 	// read ID command
 	send_command(0x90);
 	// send address 00
@@ -607,9 +1029,10 @@ void read_JEDEC_id(uint8_t* device_id_array)
 void read_unique_id(uint8_t* device_id_array, uint8_t num_data)
 {
 	// make sure none of the LUNs are busy
-	while((*jumper_address & RB_mask)==0);
+	wait_ready();
 
 	// command for read unique ID
+	cache_register_forget_all();
 	send_command(0xed);	
 	// address, lets send 00
 	send_address(0x00);
@@ -620,7 +1043,7 @@ void read_unique_id(uint8_t* device_id_array, uint8_t num_data)
 	tWB;
 
 	// make sure none of the LUNs are busy
-	while((*jumper_address & RB_mask)==0);
+	wait_ready();
 
 	// read from different address
 	// change_read_column();
@@ -665,7 +1088,8 @@ void read_status(uint8_t* status_value)
 	//insert delay here
 	// .. tWHR= 120ns
 	tWHR;
-	get_data(status_value,1);
+	// .. the status can be read while the device is busy
+	get_data_while_busy(status_value,1);
 }
 
 // use this for multi-LUN device to avoid bus contention
@@ -673,14 +1097,15 @@ void read_status(uint8_t* status_value)
 void read_status_enhanced(uint8_t* status_value, uint8_t* r1r2r3)
 {
 	send_command(0x78);
-	send_addresses(r1r2r3,3);
+	send_addresses(r1r2r3,device_geometry.row_address_cycles);
 	
 	//insert delay here
 	//insert delay here
 	// .. tWHR= 120ns
 	tWHR;
 
-	get_data(status_value,1);	
+	// .. the other LUNs might be busy and R/B# is shared
+	get_data_while_busy(status_value,1);	
 }
 
 // just a normal function to print an array to terminal
@@ -697,23 +1122,151 @@ void print_array(uint8_t* my_array, uint16_t len)
 // .. please change this if the device has multiple dies
 void change_read_column(uint8_t* col_address)
 {
-	tRHW;	// tRHW = 200ns
-
 	send_command(0x05);
-	send_addresses(col_address,2);
+	send_addresses(col_address,device_geometry.column_address_cycles);
 
 	send_command(0xe0);
 
 	tCCS;	//tCCS = 200ns
 }
 
-// follow the following function call by get_data() function call
-void change_read_column_enhanced(uint8_t* address)
+// following sorts the segments by column (insertion sort, the lists are short)
+void sort_read_segments(read_segment* segments, uint8_t num_segments)
 {
-	tRHW;	// tRHW = 200ns
+	for(uint8_t i=1;i<num_segments;i++)
+	{
+		read_segment segment = segments[i];
+		int16_t j = i-1;
+		while(j>=0 && segments[j].column>segment.column)
+		{
+			segments[j+1] = segments[j];
+			j--;
+		}
+		segments[j+1] = segment;
+	}
+}
 
-	send_command(0x06);
-	send_addresses(address,5);
+// vectored read of one page
+// .. the page is loaded once with the column of the first segment, so that one needs no column change
+// .. after that the column pointer of the device moves on by itself
+// .. .. a segment that starts where the previous one ended is read straight on
+// .. .. a short gap (up to SCATTER_GAP_SKIP_BYTES) is clocked out and thrown away
+// .. .. anything else costs one 0x05-0xE0 column change
+void read_page_vectored(uint8_t* address, read_segment* segments, uint8_t num_segments)
+{
+	uint8_t page_address[MAX_ADDRESS_CYCLES];
+	uint8_t gap[SCATTER_GAP_SKIP_BYTES];
+	uint8_t column_cycles = device_geometry.column_address_cycles;
+
+	if(num_segments==0)
+	{
+		return;
+	}
+	sort_read_segments(segments,num_segments);
+
+	memcpy(page_address,address,full_address_cycles());
+	for(uint8_t i=0;i<column_cycles;i++)
+	{
+		page_address[i] = (segments[0].column>>(8*i))&0xff;
+	}
+	read_page(page_address,full_address_cycles());
+
+	// column the device will output next
+	uint16_t cursor = segments[0].column;
+
+	for(uint8_t i=0;i<num_segments;i++)
+	{
+		uint16_t column = segments[i].column;
+
+		if(column>cursor && column-cursor<=SCATTER_GAP_SKIP_BYTES)
+		{
+			get_data_while_busy(gap,column-cursor);
+		}else if(column!=cursor)
+		{
+			uint8_t column_address[MAX_COLUMN_ADDRESS_CYCLES];
+			for(uint8_t j=0;j<column_cycles;j++)
+			{
+				column_address[j] = (column>>(8*j))&0xff;
+			}
+			change_read_column(column_address);
+		}
+		get_data_while_busy(segments[i].destination,segments[i].len);
+		cursor = column+segments[i].len;
+	}
+}
+
+// number of 1 bits in a word
+FORCE_INLINE inline uint32_t popcount32(uint32_t value)
+{
+	value = value-((value>>1)&0x55555555);
+	value = (value&0x33333333)+((value>>2)&0x33333333);
+	value = (value+(value>>4))&0x0f0f0f0f;
+	return (value*0x01010101)>>24;
+}
+
+uint32_t count_zero_bits(uint8_t* data, uint32_t len, uint32_t limit)
+{
+	uint32_t zeros = 0;
+	uint32_t i = 0;
+
+	// bytes up to a word boundary
+	for(;i<len && ((uintptr_t)(data+i)&3);i++)
+	{
+		zeros += 8-popcount32(data[i]);
+	}
+	// whole words
+	for(;i+4<=len;i+=4)
+	{
+		uint32_t word = *(uint32_t*)(data+i);
+		if(word!=0xffffffff)
+		{
+			zeros += popcount32(~word);
+			if(zeros>limit)
+			{
+				return zeros;
+			}
+		}
+	}
+	for(;i<len;i++)
+	{
+		zeros += 8-popcount32(data[i]);
+	}
+	return zeros;
+}
+
+bool is_erased(uint8_t* data, uint32_t len, uint32_t max_zero_bits)
+{
+	return count_zero_bits(data,len,max_zero_bits)<=max_zero_bits;
+}
+
+bool blank_check_page(uint8_t* address, uint32_t max_zero_bits, uint8_t* data)
+{
+	static uint32_t chunk_buffer[BLANK_CHECK_CHUNK/4];
+	uint32_t total = device_geometry.page_size+device_geometry.spare_size;
+	uint32_t zeros = 0;
+
+	read_page(address,full_address_cycles());
+	for(uint32_t done=0;done<total;done+=BLANK_CHECK_CHUNK)
+	{
+		uint16_t len = (total-done<BLANK_CHECK_CHUNK)?(total-done):BLANK_CHECK_CHUNK;
+		uint8_t* chunk = (data!=NULL)?(data+done):(uint8_t*)chunk_buffer;
+
+		get_data_while_busy(chunk,len);
+		zeros += count_zero_bits(chunk,len,max_zero_bits-zeros);
+		if(zeros>max_zero_bits)
+		{
+			// the rest of the page is never clocked out, the next command ends the read
+			return false;
+		}
+	}
+	return true;
+}
+
+// follow the following function call by get_data() function call
+void change_read_column_enhanced(uint8_t* address)
+{
+	send_command(0x06);
+	send_addresses(address,full_address_cycles());
 
 	send_command(0xe0);
 
@@ -724,8 +1277,9 @@ void change_read_column_enhanced(uint8_t* address)
 // .. this just changes the address in the selected cache register
 void change_write_column(uint8_t* col_address)
 {
+	cache_register_forget_all();
 	send_command(0x85);
-	send_addresses(col_address,2);
+	send_addresses(col_address,device_geometry.column_address_cycles);
 
 	tCCS;	//tCCS = 200ns
 }
@@ -737,90 +1291,761 @@ void change_write_column(uint8_t* col_address)
 // .. .. data input begins at the column address specified
 void change_row_address(uint8_t* address)
 {
+	cache_register_forget_all();
 	send_command(0x85);
 
-	send_addresses(address,5);
+	send_addresses(address,full_address_cycles());
 
 	// .. wait before inputting the data
 	tCCS;	//tCCS = 200ns
 }
 
-// write a function to perform an read operation from NAND flash to cache register
-// .. reads one page from the NAND to the cache register
-// .. during the read, you can use change_read_column and change_row_address
-void read_page(uint8_t* address,uint8_t address_length)
+// operations that have been submitted and not yet collected by nand_poll()/nand_wait()
+nand_operation nand_operations[NAND_MAX_OPERATIONS];
+// .. the one whose confirm command was the last one sent, NAND_INVALID_HANDLE if none is running
+nand_handle nand_running = NAND_INVALID_HANDLE;
+
+// takes a free slot for a new operation
+// .. the running one is finished first since R/B# only tells about the last operation
+void nand_finish_running()
 {
-	// make sure none of the LUNs are busy
-	while((*jumper_address & RB_mask)==0);
+	if(nand_running!=NAND_INVALID_HANDLE)
+	{
+		wait_ready();
+		nand_complete(nand_running);
+	}
+}
 
+// marks the running operation as aborted by the reset about to be sent
+// .. the page or block is left partly programmed or erased, it is not reported as a failure
+void nand_abort_running()
+{
+	if(nand_running!=NAND_INVALID_HANDLE)
+	{
+		nand_operation* operation = &nand_operations[nand_running];
+		operation->status = STATUS_FAIL;
+		operation->aborted = true;
+#if TIMER_PROFILE
+		trace_end(operation->row_address,operation->status);
+#endif
+		operation->done = true;
+		nand_running = NAND_INVALID_HANDLE;
+	}
+}
+
+nand_handle nand_begin_operation(uint8_t type)
+{
+	// 0xFF is accepted while the target is busy and is the way to stop an operation
+	if(type==NAND_OP_RESET)
+	{
+		nand_abort_running();
+	}else
+	{
+		nand_finish_running();
+	}
+
+	for(nand_handle handle=0;handle<NAND_MAX_OPERATIONS;handle++)
+	{
+		if(nand_operations[handle].type==NAND_OP_NONE)
+		{
+			nand_operations[handle].type = type;
+			nand_operations[handle].done = false;
+			nand_operations[handle].status = 0;
+			nand_operations[handle].multi_plane = false;
+			nand_operations[handle].aborted = false;
+			return handle;
+		}
+	}
+	printf("No free operation slot, collect the finished ones with nand_wait()\n");
+	return NAND_INVALID_HANDLE;
+}
+
+// marks the running operation as started
+// .. to be called right after the confirm command and tWB
+void nand_start_operation(nand_handle handle, uint8_t* row_address)
+{
+	memcpy(nand_operations[handle].row_address,row_address,device_geometry.row_address_cycles);
+	nand_running = handle;
+}
+
+nand_failure_hook failure_hook = NULL;
+
+void nand_set_failure_hook(nand_failure_hook hook)
+{
+	failure_hook = hook;
+}
+
+void nand_report_failure(uint8_t type, uint8_t* row_address, uint8_t status)
+{
+	if(failure_hook)
+	{
+		failure_hook(type,row_address,status);
+	}
+}
+
+// reports a failed program or erase, plane by plane for two-plane operations
+void nand_operation_failed(nand_operation* operation)
+{
+	if(!operation->multi_plane)
+	{
+		nand_report_failure(operation->type,operation->row_address,operation->status);
+		return;
+	}
+
+	uint8_t status_a,status_b;
+	read_status_enhanced(&status_a,operation->row_address);
+	read_status_enhanced(&status_b,operation->row_address_b);
+	// .. a device that does not keep the status per plane gets both reported
+	bool per_plane = (status_a|status_b)&STATUS_FAIL;
+	if(!per_plane || (status_a&STATUS_FAIL))
+	{
+		nand_report_failure(operation->type,operation->row_address,operation->status);
+	}
+	if(!per_plane || (status_b&STATUS_FAIL))
+	{
+		nand_report_failure(operation->type,operation->row_address_b,operation->status);
+	}
+}
+
+// finishes the running operation once R/B# is high
+void nand_complete(nand_handle handle)
+{
+	nand_operation* operation = &nand_operations[handle];
+	if(operation->type==NAND_OP_READ)
+	{
+		// there is no status to check after a page read and reading it would need a 0x00 afterwards
+		// .. to go back to data output, so it is not read
+		operation->status = STATUS_RDY|STATUS_ARDY;
+		// tRR = 40ns
+		tRR;
+	}else
+	{
+		read_status(&operation->status);
+		if((operation->status&STATUS_FAIL) && (operation->type==NAND_OP_PROGRAM || operation->type==NAND_OP_ERASE))
+		{
+			nand_operation_failed(operation);
+		}
+	}
+#if TIMER_PROFILE
+	trace_end(operation->row_address,operation->status);
+#endif
+	operation->done = true;
+	nand_running = NAND_INVALID_HANDLE;
+}
+
+#if TRACK_CACHE_REGISTER
+uint8_t cache_register_row[CACHE_REGISTER_MAX_LUNS][MAX_ROW_ADDRESS_CYCLES];
+bool cache_register_valid[CACHE_REGISTER_MAX_LUNS];
+#endif
+uint32_t cache_register_hits = 0;
+
+void cache_register_forget(uint8_t* row_address)
+{
+#if TRACK_CACHE_REGISTER
+	uint8_t lun;
+
+	split_row_address(row_address,&lun,NULL,NULL);
+	if(lun<CACHE_REGISTER_MAX_LUNS)
+	{
+		cache_register_valid[lun] = false;
+	}
+#else
+	(void)row_address;
+#endif
+}
+
+void cache_register_forget_all()
+{
+#if TRACK_CACHE_REGISTER
+	memset(cache_register_valid,0,sizeof(cache_register_valid));
+#endif
+}
+
+// the page of a read is in the register of its LUN once tR is over
+// .. a read with a short address is not tracked
+void cache_register_record(uint8_t* address,uint8_t address_length)
+{
+#if TRACK_CACHE_REGISTER
+	uint8_t* row_address = address+device_geometry.column_address_cycles;
+	uint8_t lun;
+
+	cache_register_forget(row_address);
+	split_row_address(row_address,&lun,NULL,NULL);
+	if(address_length==full_address_cycles() && lun<CACHE_REGISTER_MAX_LUNS)
+	{
+		memcpy(cache_register_row[lun],row_address,device_geometry.row_address_cycles);
+		cache_register_valid[lun] = true;
+	}
+#else
+	(void)address;
+	(void)address_length;
+#endif
+}
+
+#if TRACK_CACHE_REGISTER
+bool cache_register_holds(uint8_t* row_address)
+{
+	uint8_t lun;
+
+	split_row_address(row_address,&lun,NULL,NULL);
+	return lun<CACHE_REGISTER_MAX_LUNS && cache_register_valid[lun]
+		&& memcmp(cache_register_row[lun],row_address,device_geometry.row_address_cycles)==0;
+}
+#endif
+
+// command sequence of a page read, without any look at R/B#
+void issue_page_read(uint8_t* address,uint8_t address_length)
+{
+	cache_register_record(address,address_length);
 	send_command(0x00);
 	send_addresses(address,address_length);
+	send_command(0x30);
 #if TIMER_PROFILE
-	printf("Page read Operation Follows\n");
-	timer_start();
+	trace_begin(NAND_OP_READ,address+device_geometry.column_address_cycles);
 #endif
-	send_command(0x30);
 
 	// just a delay
 	tWB;
+}
 
-	// check for RDY signal
-	while((*jumper_address & RB_mask)==0);
+// command sequence of a page program, without any look at R/B#
+void issue_page_program(uint8_t* address,uint8_t* data,uint16_t num_data)
+{
+	cache_register_forget(address+device_geometry.column_address_cycles);
+	send_command(0x80);
+	send_addresses(address,full_address_cycles());
+
+	// tADL
+	tADL;
+
+	send_data(data,num_data);
+	send_command(0x10);
 #if TIMER_PROFILE
-	PRINT_CC_TAKEN;
-#endif	
-	// tRR = 40ns
-	asm("nop");
+	trace_begin(NAND_OP_PROGRAM,address+device_geometry.column_address_cycles);
+#endif
+
+	tWB;
+	
+#if DEBUG
+	printf("Inside program Fn: Address is: ");
+	print_array(address,full_address_cycles());
+#endif
 }
 
+// command sequence of a block erase, without any look at R/B#
+void issue_block_erase(uint8_t* row_address)
+{
+	cache_register_forget(row_address);
+	send_command(0x60);
+	send_addresses(row_address,device_geometry.row_address_cycles);
+	send_command(0xd0);
+#if TIMER_PROFILE
+	trace_begin(NAND_OP_ERASE,row_address);
+#endif
 
-// following is the faster read operation
-// .. essentially calls the read_page function above
-// .. and reads the output data from the cache and at the same time copies next page to the data regsiter
-void read_page_cache_sequential(uint8_t* address, uint8_t address_length,uint8_t* data_read,uint16_t* data_read_len,uint16_t num_pages)
+	tWB;
+	
+#if DEBUG
+	printf("Inside Erase Fn: Address is: ");
+	print_array(row_address,device_geometry.row_address_cycles);
+#endif
+}
+
+// function to start a page read (0x00 address 0x30) and return without waiting for tR
+nand_handle nand_submit_read(uint8_t* address,uint8_t address_length)
 {
+	nand_handle handle = nand_begin_operation(NAND_OP_READ);
+	if(handle==NAND_INVALID_HANDLE)
+	{
+		return handle;
+	}
 	// make sure none of the LUNs are busy
-	while((*jumper_address & RB_mask)==0);
+	wait_ready();
+
+	issue_page_read(address,address_length);
+
+	nand_start_operation(handle,address+device_geometry.column_address_cycles);
+	return handle;
+}
+
+// function to start a page program (0x80 address data 0x10) and return without waiting for tPROG
+nand_handle nand_submit_program(uint8_t* address,uint8_t* data,uint16_t num_data)
+{
+	nand_handle handle = nand_begin_operation(NAND_OP_PROGRAM);
+	if(handle==NAND_INVALID_HANDLE)
+	{
+		return handle;
+	}
+	issue_page_program(address,data,num_data);
+
+	nand_start_operation(handle,address+device_geometry.column_address_cycles);
+	return handle;
+}
+
+// function to start a block erase (0x60 row address 0xD0) and return without waiting for tBERS
+nand_handle nand_submit_erase(uint8_t* row_address)
+{
+	nand_handle handle = nand_begin_operation(NAND_OP_ERASE);
+	if(handle==NAND_INVALID_HANDLE)
+	{
+		return handle;
+	}
+	port_direction_write(port_direction_shadow & ~(RB_mask));
+
+	// check if it is out of Busy cycle
+	wait_ready();
+
+	issue_block_erase(row_address);
+
+	nand_start_operation(handle,row_address);
+	return handle;
+}
+
+// function to start a reset (0xFF) and return without waiting for it
+nand_handle nand_submit_reset()
+{
+	nand_handle handle = nand_begin_operation(NAND_OP_RESET);
+	if(handle==NAND_INVALID_HANDLE)
+	{
+		return handle;
+	}
+	// oxff is reset command
+	cache_register_forget_all();
+	send_command(0xff);
+	// no address is expected for reset command
+	// .. we should wait for tWB = 200ns before the RB signal is valid
+	tWB;	// tWB = 200ns
+
+	uint8_t no_row[MAX_ROW_ADDRESS_CYCLES] = {0};
+#if TIMER_PROFILE
+	trace_begin(NAND_OP_RESET,no_row);
+#endif
+	nand_start_operation(handle,no_row);
+	return handle;
+}
+
+uint8_t plane_of(uint8_t* row_address)
+{
+	uint32_t block;
+	split_row_address(row_address,NULL,&block,NULL);
+	// .. the plane is selected by the lowest block address bits
+	return block&(device_geometry.num_planes-1);
+}
+
+bool multi_plane_address_valid(uint8_t* row_address_a, uint8_t* row_address_b)
+{
+	uint8_t lun_a,lun_b;
+	uint32_t page_a,page_b;
+
+	if(device_geometry.num_planes<2)
+	{
+		return false;
+	}
+	split_row_address(row_address_a,&lun_a,NULL,&page_a);
+	split_row_address(row_address_b,&lun_b,NULL,&page_b);
+
+	// same LUN, same page in block, and different planes
+	return lun_a==lun_b && page_a==page_b && plane_of(row_address_a)!=plane_of(row_address_b);
+}
+
+// following checks the pair of full addresses and prints the reason when they cannot go together
+bool multi_plane_check(uint8_t* address_a, uint8_t* address_b)
+{
+	if(!multi_plane_address_valid(address_a+device_geometry.column_address_cycles,address_b+device_geometry.column_address_cycles))
+	{
+		printf("Not a valid multi-plane pair (needs same LUN, same page, different planes)\n");
+		return false;
+	}
+	return true;
+}
+
+// function to start a two-plane page program
+// .. 0x80 address-a data 0x11, tDBSY, 0x80 address-b data 0x10
+nand_handle nand_submit_program_multi_plane(uint8_t* address_a,uint8_t* data_a,uint8_t* address_b,uint8_t* data_b,uint16_t num_data)
+{
+	if(!multi_plane_check(address_a,address_b))
+	{
+		return NAND_INVALID_HANDLE;
+	}
+	nand_handle handle = nand_begin_operation(NAND_OP_PROGRAM);
+	if(handle==NAND_INVALID_HANDLE)
+	{
+		return handle;
+	}
+
+	// first plane goes to its cache register
+	cache_register_forget(address_a+device_geometry.column_address_cycles);
+	send_command(0x80);
+	send_addresses(address_a,full_address_cycles());
+	tADL;
+	send_data(data_a,num_data);
+	send_command(0x11);
+	tWB;
+	// .. tDBSY
+	wait_ready();
+
+	// second plane and the confirm command program both
+	send_command(0x80);
+	send_addresses(address_b,full_address_cycles());
+	tADL;
+	send_data(data_b,num_data);
+	send_command(0x10);
+#if TIMER_PROFILE
+	trace_begin(NAND_OP_PROGRAM,address_a+device_geometry.column_address_cycles);
+#endif
+	tWB;
+
+	nand_start_operation(handle,address_a+device_geometry.column_address_cycles);
+	nand_operations[handle].multi_plane = true;
+	memcpy(nand_operations[handle].row_address_b,address_b+device_geometry.column_address_cycles,device_geometry.row_address_cycles);
+	return handle;
+}
+
+// function to start a two-plane block erase
+// .. 0x60 row-a 0x60 row-b 0xD0
+nand_handle nand_submit_erase_multi_plane(uint8_t* row_address_a,uint8_t* row_address_b)
+{
+	if(!multi_plane_address_valid(row_address_a,row_address_b))
+	{
+		printf("Not a valid multi-plane pair (needs same LUN, different planes)\n");
+		return NAND_INVALID_HANDLE;
+	}
+	nand_handle handle = nand_begin_operation(NAND_OP_ERASE);
+	if(handle==NAND_INVALID_HANDLE)
+	{
+		return handle;
+	}
+	wait_ready();
+
+	cache_register_forget(row_address_a);
+	send_command(0x60);
+	send_addresses(row_address_a,device_geometry.row_address_cycles);
+	send_command(0x60);
+	send_addresses(row_address_b,device_geometry.row_address_cycles);
+	send_command(0xd0);
+#if TIMER_PROFILE
+	trace_begin(NAND_OP_ERASE,row_address_a);
+#endif
+	tWB;
+
+	nand_start_operation(handle,row_address_a);
+	nand_operations[handle].multi_plane = true;
+	memcpy(nand_operations[handle].row_address_b,row_address_b,device_geometry.row_address_cycles);
+	return handle;
+}
 
+// function to start a two-plane page read
+// .. 0x00 address-a 0x32, tDBSY, 0x00 address-b 0x30
+nand_handle nand_submit_read_multi_plane(uint8_t* address_a,uint8_t* address_b)
+{
+	if(!multi_plane_check(address_a,address_b))
+	{
+		return NAND_INVALID_HANDLE;
+	}
+	nand_handle handle = nand_begin_operation(NAND_OP_READ);
+	if(handle==NAND_INVALID_HANDLE)
+	{
+		return handle;
+	}
+	wait_ready();
+
+	cache_register_forget(address_a+device_geometry.column_address_cycles);
 	send_command(0x00);
-	send_addresses(address,address_length);
-	send_command(0x30);
+	send_addresses(address_a,full_address_cycles());
+	send_command(0x32);
+	tWB;
+	// .. tDBSY
+	wait_ready();
 
-	// just a delay
+	send_command(0x00);
+	send_addresses(address_b,full_address_cycles());
+	send_command(0x30);
+#if TIMER_PROFILE
+	trace_begin(NAND_OP_READ,address_a+device_geometry.column_address_cycles);
+#endif
 	tWB;
 
-	// check if it is out of Busy cycle
-	while((*jumper_address & RB_mask)==0);
-	// lets wait again
+	nand_start_operation(handle,address_a+device_geometry.column_address_cycles);
+	return handle;
+}
+
+uint8_t program_page_multi_plane(uint8_t* address_a,uint8_t* data_a,uint8_t* address_b,uint8_t* data_b,uint16_t num_data)
+{
+	uint8_t status = nand_wait(nand_submit_program_multi_plane(address_a,data_a,address_b,data_b,num_data));
+	if(status&STATUS_FAIL)
+	{
+		printf("Failed Multi-plane Program Operation\n");
+	}
+	return status;
+}
+
+uint8_t erase_block_multi_plane(uint8_t* row_address_a,uint8_t* row_address_b)
+{
+	uint8_t status = nand_wait(nand_submit_erase_multi_plane(row_address_a,row_address_b));
+	if(status&STATUS_FAIL)
+	{
+		printf("Failed Multi-plane Erase Operation\n");
+	}
+	return status;
+}
+
+uint8_t read_page_multi_plane(uint8_t* address_a,uint8_t* data_a,uint8_t* address_b,uint8_t* data_b,uint16_t num_data)
+{
+	uint8_t status = nand_wait(nand_submit_read_multi_plane(address_a,address_b));
+	if(status&STATUS_FAIL)
+	{
+		return status;
+	}
+
+	// each plane has its own cache register, 0x06-0xE0 selects plane and column
+	change_read_column_enhanced(address_a);
+	get_data(data_a,num_data);
+	change_read_column_enhanced(address_b);
+	get_data(data_b,num_data);
+	return status;
+}
+
+bool nand_poll(nand_handle handle, uint8_t* status)
+{
+	if(handle>=NAND_MAX_OPERATIONS || nand_operations[handle].type==NAND_OP_NONE)
+	{
+		return false;
+	}
+	if(!nand_operations[handle].done)
+	{
+		// only one look at R/B#
+		if((port_read() & RB_mask)==0)
+		{
+			return false;
+		}
+		nand_complete(handle);
+	}
+	if(status)
+	{
+		*status = nand_operations[handle].status;
+	}
+	// the slot can be used again
+	nand_operations[handle].type = NAND_OP_NONE;
+	return true;
+}
+
+uint8_t nand_wait(nand_handle handle)
+{
+	if(handle>=NAND_MAX_OPERATIONS || nand_operations[handle].type==NAND_OP_NONE)
+	{
+		return STATUS_FAIL;
+	}
+	uint8_t status;
+	while(!nand_poll(handle,&status));
+	return status;
+}
+
+// write a function to perform an read operation from NAND flash to cache register
+// .. reads one page from the NAND to the cache register
+// .. during the read, you can use change_read_column and change_row_address
+void read_page(uint8_t* address,uint8_t address_length)
+{
+#if TRACK_CACHE_REGISTER
+	if(address_length==full_address_cycles() && cache_register_holds(address+device_geometry.column_address_cycles))
+	{
+		nand_finish_running();
+		wait_ready();
+		if(device_geometry.num_luns>1)
+		{
+			change_read_column_enhanced(address);
+		}else
+		{
+			change_read_column(address);
+		}
+		cache_register_hits++;
+		return;
+	}
+#endif
+	nand_wait(nand_submit_read(address,address_length));
+}
+
+// following is the faster read operation
+// .. reads num_pages pages starting at address in to one buffer, page after page
+// .. this is the cache read stream with a ring as large as the whole read
+void read_page_cache_sequential(uint8_t* address, uint8_t address_length,uint8_t* data_read,uint16_t* data_read_len,uint16_t num_pages)
+{
+	(void)address_length;
+	page_ring ring = {data_read,num_pages,device_geometry.page_size,NULL,NULL,0};
+
+	*data_read_len = device_geometry.page_size;
+	read_page_cache_stream(address+device_geometry.column_address_cycles,num_pages,&ring);
+}
+
+// next row address of a sequential stream, moves on to the next block (and LUN) at the end of a block
+void next_row_address(uint8_t* row_address)
+{
+	uint8_t lun;
+	uint32_t block,page;
+
+	split_row_address(row_address,&lun,&block,&page);
+	page++;
+	if(page==device_geometry.pages_per_block)
+	{
+		page = 0;
+		block++;
+		if(block==device_geometry.blocks_per_lun)
+		{
+			block = 0;
+			lun++;
+		}
+	}
+	make_row_address(lun,block,page,row_address);
+}
+
+// the cache read pipeline shared by the sequential and the random stream
+// .. row_list is NULL for a sequential stream from first_row
+// .. .. otherwise it has num_pages row addresses one after the other
+// .. following is the sequence
+// .. .. 0x00 address(page 0) 0x30 and wait for tR
+// .. .. then for every page i:
+// .. .. .. 0x31 (or 0x00 address(page i+1) 0x31) moves page i to the cache register and starts reading page i+1
+// .. .. .. 0x3F instead for the last page, which starts no new read
+// .. .. .. page i is clocked out to its ring slot and handed to the consumer
+// .. .. .. .. both while the array is reading page i+1
+// .. .. a cache read cannot go on in another LUN, so before a page of another LUN
+// .. .. .. the pipeline is ended with 0x3F and started again with 0x00 address 0x30
+void read_page_cache_pipeline(uint8_t* first_row, uint8_t* row_list, uint32_t num_pages, page_ring* ring)
+{
+	uint8_t address[MAX_ADDRESS_CYCLES] = {0};
+	uint8_t current_row[MAX_ROW_ADDRESS_CYCLES];
+	uint8_t* row_bytes = address+device_geometry.column_address_cycles;
+	uint8_t row_cycles = device_geometry.row_address_cycles;
+
+	if(num_pages==0)
+	{
+		return;
+	}
+
+	// nothing else can be running
+	nand_finish_running();
+	wait_ready();
+	// .. the stream leaves the data and cache registers of its LUNs with pages it does not track
+	cache_register_forget_all();
+
+	memcpy(row_bytes,row_list?row_list:first_row,row_cycles);
+	send_command(0x00);
+	send_addresses(address,full_address_cycles());
+	send_command(0x30);
+	tWB;
+	wait_ready();
 	tRR;
 
-	for(uint16_t page_num = 0;page_num<num_pages-1;page_num++)
+	for(uint32_t page_index=0;page_index<num_pages;page_index++)
 	{
-		send_command(0x31);
-		// just a delay
-		tWB;
+		// true when the next page is in another LUN
+		bool restart = false;
 
-		// check if it is out of Busy cycle
-		while((*jumper_address & RB_mask)==0);
-		// lets wait again
+		// row of the page that is in the data register now
+		memcpy(current_row,row_bytes,row_cycles);
+
+		if(page_index==num_pages-1)
+		{
+			// read page cache last
+			send_command(0x3f);
+		}else
+		{
+			uint8_t current_lun,next_lun;
+			uint32_t current_block,next_block;
+			split_row_address(row_bytes,&current_lun,&current_block,NULL);
+			if(row_list)
+			{
+				memcpy(row_bytes,row_list+(page_index+1)*row_cycles,row_cycles);
+			}else
+			{
+				next_row_address(row_bytes);
+			}
+			split_row_address(row_bytes,&next_lun,&next_block,NULL);
+
+			if(next_lun!=current_lun)
+			{
+				// read page cache last, the next page is read on its own below
+				restart = true;
+				send_command(0x3f);
+			}else
+			{
+				if(row_list || next_block!=current_block)
+				{
+					// random cache read, the next page is given by its address
+					send_command(0x00);
+					send_addresses(address,full_address_cycles());
+				}
+				send_command(0x31);
+			}
+		}
+		tWB;
+		// .. tRCBSY
+		wait_ready();
 		tRR;
 
-		*data_read_len = 8192;
-		get_data(data_read+(page_num*(*data_read_len)),*data_read_len);
-	}	
+		uint8_t* slot = ring->buffer+(uint32_t)(page_index%ring->num_slots)*ring->page_len;
+		if(ring->column)
+		{
+			uint8_t column_address[MAX_COLUMN_ADDRESS_CYCLES];
+			for(uint8_t i=0;i<device_geometry.column_address_cycles;i++)
+			{
+				column_address[i] = (ring->column>>(8*i))&0xff;
+			}
+			change_read_column(column_address);
+		}
+		get_data_while_busy(slot,ring->page_len);
 
-	// read page cache last
-	send_command(0x3f);
-	// just a delay
-	tWB;
+		if(ring->consumer)
+		{
+			ring->consumer(page_index,current_row,slot,ring->context);
+		}
 
-	// check if it is out of Busy cycle
-	while((*jumper_address & RB_mask)==0);
-	// lets wait again
-	tRR;
+		if(restart)
+		{
+			send_command(0x00);
+			send_addresses(address,full_address_cycles());
+			send_command(0x30);
+			tWB;
+			wait_ready();
+			tRR;
+		}
+	}
+}
+
+void read_page_cache_stream(uint8_t* row_address, uint32_t num_pages, page_ring* ring)
+{
+	read_page_cache_pipeline(row_address,NULL,num_pages,ring);
+}
 
-	*data_read_len = 8192;
-	get_data(data_read+((num_pages-1)*(*data_read_len)),*data_read_len);
+void read_page_cache_random(uint8_t* row_addresses, uint32_t num_pages, page_ring* ring)
+{
+	read_page_cache_pipeline(NULL,row_addresses,num_pages,ring);
+}
+
+// spare area scan
+// .. with cache read the pages go through the cache read pipeline with a ring that has one
+// .. .. oob_len slot per page, and a column change to the spare slice in front of each page
+// .. without it every page is a page read at the column of the slice
+void scan_spare_area(uint8_t lun, uint32_t first_block, uint32_t num_blocks, uint16_t oob_offset, uint16_t oob_len, uint8_t* metadata, bool use_cache_read)
+{
+	uint32_t num_pages = num_blocks*device_geometry.pages_per_block;
+	uint16_t column = device_geometry.page_size+oob_offset;
+	uint8_t address[MAX_ADDRESS_CYCLES];
+
+	if(use_cache_read)
+	{
+		page_ring ring = {metadata,num_pages,oob_len,NULL,NULL,column};
+		make_row_address(lun,first_block,0,address);
+		read_page_cache_stream(address,num_pages,&ring);
+		return;
+	}
+
+	make_page_address(lun,first_block,0,column,address);
+	for(uint32_t page_index=0;page_index<num_pages;page_index++)
+	{
+		read_page(address,full_address_cycles());
+		get_data_while_busy(metadata+page_index*oob_len,oob_len);
+		next_row_address(address+device_geometry.column_address_cycles);
+	}
 }
 
 // enables data output for the last selected die and cache register
@@ -835,39 +2060,11 @@ void read_mode()
 // .. during program operation, the contents of cache or data registers are modified by internal control logic
 // .. pages in a block should be programmed from the least significant page to the most sign addres
 // .. programming pages out of order in a block is not allowed
-// .. address: should be 5 bytes and data should be 
+// .. address: column and row address, full_address_cycles() bytes (5 for MT29F64G08CBABA)
 void program_page(uint8_t* address,uint8_t* data,uint16_t num_data)
 {
-	send_command(0x80);
-	send_addresses(address,5);
-
-	// tADL
-	tADL;
-
-	send_data(data,num_data);
-#if TIMER_PROFILE
-	printf("Program Page Operation Follows\n");
-	timer_start();
-#endif
-	send_command(0x10);
-
-	tWB;
-	
-#if DEBUG
-	printf("Inside program Fn: Address is: ");
-	print_array(address,5);
-#endif
-	// check if it is out of Busy cycle
-	while((*jumper_address & RB_mask)==0);
-#if TIMER_PROFILE
-	PRINT_CC_TAKEN;
-#endif	
-
-	uint8_t status_value;
-	// .. use  the commended code for multi-plane die
-	// read_status_enhanced(&status_value,(address+2));
-	read_status(&status_value);
-	if(status_value&0x01)
+	uint8_t status_value = nand_wait(nand_submit_program(address,data,num_data));
+	if(status_value&STATUS_FAIL)
 	{
 		printf("Failed Program Operation\n");
 	}else
@@ -877,7 +2074,6 @@ printf("Program Operation Successful\n");
 #endif
 	}
 }
-
 // function used to program multiple pages
 // the data is copied to the cache, and then to the NAND memory
 // .. there is no need to wait for the previous operation to complete
@@ -887,10 +2083,11 @@ printf("Program Operation Successful\n");
 // num_data is the number of bytes of data in data array
 void program_page_cache(uint8_t* address,uint8_t* data,uint16_t num_data,uint8_t num_pages)
 {
+	cache_register_forget_all();
 	for(uint8_t page_num = 0;page_num<num_pages-1;page_num++)	
 	{
 		send_command(0x80);
-		send_addresses(address+(5*page_num),5);
+		send_addresses(address+(full_address_cycles()*page_num),full_address_cycles());
 
 		// tADL
 		tADL;
@@ -901,10 +2098,10 @@ void program_page_cache(uint8_t* address,uint8_t* data,uint16_t num_data,uint8_t
 		tWB;
 
 		// check if it is out of Busy cycle
-		while((*jumper_address & RB_mask)==0);
+		wait_ready();
 	}
 	send_command(0x80);
-	send_addresses((address+5*(num_pages-1)),5);
+	send_addresses((address+full_address_cycles()*(num_pages-1)),full_address_cycles());
 
 	// tADL
 	tADL;
@@ -915,7 +2112,7 @@ void program_page_cache(uint8_t* address,uint8_t* data,uint16_t num_data,uint8_t
 	tWB;
 
 	// check if it is out of Busy cycle
-	while((*jumper_address & RB_mask)==0);
+	wait_ready();
 
 	uint8_t status_value;
 	// .. use  the commended code for multi-plane die
@@ -932,38 +2129,133 @@ printf("Program Operation Successful\n");
 	}
 }
 
-void erase_block(uint8_t* row_address)
-{	
-	*jumper_direction &= ~RB_mask;
+// following polls the status register until all the bits of ready_mask are set
+// .. 0x70 is sent once and then the status is clocked out again and again
+uint8_t wait_status(uint8_t ready_mask)
+{
+	uint8_t status;
 
-	// check if it is out of Busy cycle
-	while((*jumper_address & RB_mask)==0);
+	send_command(0x70);
+	tWHR;
+	do
+	{
+		get_data_while_busy(&status,1);
+	}while((status&ready_mask)!=ready_mask);
+	return status;
+}
 
-	send_command(0x60);
-	send_addresses(row_address,3);
-#if TIMER_PROFILE
-	printf("Erase Block Operation Follows\n");
-	timer_start();
-#endif
-	send_command(0xd0);
+// streaming cache program
+// .. a run of cache programs lasts until the last page of the stream or of the block
+// .. .. every page but the last of a run is confirmed with 0x15, the last one with 0x10
+// .. after 0x15 we only wait for RDY (cache register free) and load the next page
+// .. .. while the array is still programming the previous one (ARDY low)
+// .. at that point FAILC tells about the page before, and after the final 0x10 FAIL tells about the last page
+uint32_t program_page_cache_stream(uint8_t* row_address,uint32_t num_pages,uint16_t num_data,page_producer producer,page_failure_handler on_failure,void* context)
+{
+	uint8_t lun;
+	uint32_t block,page;
+	uint8_t address[MAX_ADDRESS_CYCLES];
+	uint8_t previous_row[MAX_ROW_ADDRESS_CYCLES];
+	uint32_t failed_pages = 0;
+	// .. true if the previous page was cache programmed in the current run
+	bool previous_in_run = false;
+
+	split_row_address(row_address,&lun,&block,&page);
+
+	// nothing else can be running
+	nand_finish_running();
+	wait_ready();
+	cache_register_forget(row_address);
+
+	for(uint32_t page_index=0;page_index<num_pages;page_index++)
+	{
+		bool last_in_run = (page_index==num_pages-1) || (page+1==device_geometry.pages_per_block);
 
-	tWB;
-	
-#if DEBUG
-	printf("Inside Erase Fn: Address is: ");
-	print_array(row_address,3);
-#endif
+		make_page_address(lun,block,page,0,address);
 
-	// check if it is out of Busy cycle
-	while((*jumper_address & RB_mask)==0);
-#if TIMER_PROFILE
-	PRINT_CC_TAKEN;
-#endif	
+		send_command(0x80);
+		send_addresses(address,full_address_cycles());
+		tADL;
+		send_data(producer(page_index,context),num_data);
+		send_command(last_in_run?0x10:0x15);
+		tWB;
 
-	// let us read the status register value
-	uint8_t status;
-	read_status(&status);	
-	if(status&0x01)
+		uint8_t status = wait_status(last_in_run?(STATUS_RDY|STATUS_ARDY):STATUS_RDY);
+
+		if(previous_in_run && (status&STATUS_FAILC))
+		{
+			failed_pages++;
+			nand_report_failure(NAND_OP_PROGRAM,previous_row,status);
+			if(on_failure)
+			{
+				on_failure(page_index-1,previous_row,context);
+			}
+		}
+		if(last_in_run && (status&STATUS_FAIL))
+		{
+			failed_pages++;
+			nand_report_failure(NAND_OP_PROGRAM,address+device_geometry.column_address_cycles,status);
+			if(on_failure)
+			{
+				on_failure(page_index,address+device_geometry.column_address_cycles,context);
+			}
+		}
+
+		memcpy(previous_row,address+device_geometry.column_address_cycles,device_geometry.row_address_cycles);
+		previous_in_run = !last_in_run;
+
+		// next page, next block at the end of this one
+		page++;
+		if(page==device_geometry.pages_per_block)
+		{
+			page = 0;
+			block++;
+			if(block==device_geometry.blocks_per_lun)
+			{
+				block = 0;
+				lun++;
+			}
+		}
+	}
+	return failed_pages;
+}
+
+// producer and failure handler for program_pages_cache()
+typedef struct
+{
+	uint8_t** pages;
+	bool* failed;
+}page_array_context;
+
+uint8_t* page_array_producer(uint32_t page_index, void* context)
+{
+	return ((page_array_context*)context)->pages[page_index];
+}
+
+void page_array_failure(uint32_t page_index, uint8_t* row_address, void* context)
+{
+	(void)row_address;
+	bool* failed = ((page_array_context*)context)->failed;
+	if(failed)
+	{
+		failed[page_index] = true;
+	}
+}
+
+uint32_t program_pages_cache(uint8_t* row_address,uint8_t** pages,uint32_t num_pages,uint16_t num_data,bool* failed)
+{
+	page_array_context context = {pages,failed};
+	if(failed)
+	{
+		memset(failed,0,num_pages*sizeof(bool));
+	}
+	return program_page_cache_stream(row_address,num_pages,num_data,page_array_producer,page_array_failure,&context);
+}
+
+void erase_block(uint8_t* row_address)
+{	
+	uint8_t status = nand_wait(nand_submit_erase(row_address));
+	if(status&STATUS_FAIL)
 	{
 		printf("Failed Erase Operation\n");
 	}else
@@ -973,22 +2265,22 @@ printf("Erase Operation Successful\n");
 #endif
 	}
 }
-
 // following is the partial erase operation function
 void partial_erase_block(uint8_t* row_address, uint8_t lp_cnt)
 {	
-	*jumper_direction &= ~RB_mask;
+	port_direction_write(port_direction_shadow & ~(RB_mask));
 
 	// check if it is out of Busy cycle
-	while((*jumper_address & RB_mask)==0);
+	wait_ready();
+	// .. the reset at the end clears the registers of all LUNs
+	cache_register_forget_all();
 
 	send_command(0x60);
-	send_addresses(row_address,3);
+	send_addresses(row_address,device_geometry.row_address_cycles);
+	send_command(0xd0);
 #if TIMER_PROFILE
-	printf("Partial Erase Block Operation Follows\n");
-	timer_start();
+	trace_begin(NAND_OP_ERASE,row_address);
 #endif
-	send_command(0xd0);
 
 	tWB;
 
@@ -996,21 +2288,20 @@ void partial_erase_block(uint8_t* row_address, uint8_t lp_cnt)
 		
 	// let us issue reset command here
 	send_command(0xff);
-#if TIMER_PROFILE
-	PRINT_CC_TAKEN;
-#endif
-	
 #if DEBUG
 	printf("Inside Erase Fn: Address is: ");
-	print_array(row_address,3);
+	print_array(row_address,device_geometry.row_address_cycles);
 #endif
 
 	// check if it is out of Busy cycle
-	while((*jumper_address & RB_mask)==0);
+	wait_ready();
 
 	// let us read the status register value
 	uint8_t status;
 	read_status(&status);	
+#if TIMER_PROFILE
+	trace_end(row_address,status);
+#endif
 	if(status&0x01)
 	{
 		printf("Failed Erase Operation\n");
@@ -18,10 +18,56 @@ Description: This file has the essential functions that are needed for interfaci
 // .. set to false for experimentation
 #define DEBUG false
 #define FORCE_INLINE __attribute__((always_inline))
-// set the following variable to true if you want to following functions:
-// .. timer_start()
-// .. timer_end()
+// set the following variable to true to record every array operation in the trace ring (nand_trace.h)
+// .. call trace_init() first and trace_dump() after the workload
+// .. the latency histograms (nand_histogram.h) are filled at the same time, histogram_init() empties them
+// .. timer_start(), timer_end() and timer_diff() are there either way
+#ifndef TIMER_PROFILE
 #define TIMER_PROFILE false
+#endif
+
+// set the following variable to true to build the driver on a linux host
+// .. every access to the parallel port goes through port_store(), port_read() and port_direction_write()
+// .. .. which use the PIO registers, or with HOST_SIMULATION host_port_write()/host_port_read()
+// .. .. of the device model in nand_simulator.c, so no NIOS peripheral is touched
+// .. the delays and the timer then follow the virtual clock of the model
+// .. pass -DHOST_SIMULATION=true to the compiler for this and call nand_simulator_open() first
+#ifndef HOST_SIMULATION
+#define HOST_SIMULATION false
+#endif
+
+// set the following variable to true to count every load and store on the parallel port
+// .. see port_counter_reset() and port_counter_report()
+#ifndef PORT_PROFILE
+#define PORT_PROFILE false
+#endif
+
+// set the following variable to true to capture every port access with a timer snapshot
+// .. and check the waveform against the ONFI timings, see nand_timing_check.h
+#ifndef TIMING_CHECK
+#define TIMING_CHECK false
+#endif
+
+// set the following variable to false to always load the page in read_page()
+// .. see cache_register_forget() for what the tracking relies on
+#ifndef TRACK_CACHE_REGISTER
+#define TRACK_CACHE_REGISTER true
+#endif
+
+#if HOST_SIMULATION
+// .. stand-in for the timer registers when running on the host
+extern uint32_t host_timer_registers[6];
+#define TIMER_BASE (&host_timer_registers[0])
+#define TIMER_CONTROL (&host_timer_registers[1])
+#define TIMER_COUNTER_LOW (&host_timer_registers[2])
+#define TIMER_COUNTER_HIGH (&host_timer_registers[3])
+#define TIMER_COUNTER_SNAP_LOW (&host_timer_registers[4])
+#define TIMER_COUNTER_SNAP_HIGH (&host_timer_registers[5])
+// .. restarts the count from the virtual clock
+void host_timer_start();
+// .. fills the snapshot registers from the virtual clock
+void host_timer_snapshot();
+#else
 // following are the registers in NIOS computer
 // .. the base address
 #define TIMER_BASE ((uint32_t*) 0xff202000)
@@ -35,6 +81,7 @@ Description: This file has the essential functions that are needed for interfaci
 #define TIMER_COUNTER_SNAP_LOW ((uint32_t*) 0xff202010)
 // .. timer counter snapshot high (only 16-bits)
 #define TIMER_COUNTER_SNAP_HIGH ((uint32_t*) 0xff202014)
+#endif
 // .. instead of making call to timer_diff(), use the following statement
 #define PRINT_CC_TAKEN printf(".. the last operation took %lu cc.\n",timer_diff())
 
@@ -52,6 +99,9 @@ FORCE_INLINE inline void timer_start()
 	*TIMER_COUNTER_HIGH = 0xffff;
 	// .. bit 0: interupt enable, bit 1: continuous mode, bit 2:start counting
 	*TIMER_CONTROL = 0x006; //0b0110
+#if HOST_SIMULATION
+	host_timer_start();
+#endif
 }
 
 // function timer_end()
@@ -62,6 +112,9 @@ FORCE_INLINE inline void timer_end()
 	// grab the snap shot value
 	// .. to catch the snapshot value, just write anything to the snap register
 	*TIMER_COUNTER_SNAP_LOW = 1;
+#if HOST_SIMULATION
+	host_timer_snapshot();
+#endif
 	// now we can stop the timer
 	// .. bit 3 is STOP
 	*TIMER_CONTROL = 0x08;
@@ -91,7 +144,8 @@ FORCE_INLINE inline  uint32_t timer_diff()
 
 #define PUSH_KEY_LOCATION ((uint32_t*) 0xff200050)
 
-#define DQ_mask (0x000000ff)	//connected at D7D6..D0
+#define DQ_shift 0
+#define DQ_mask (0xff<<DQ_shift)	//connected at D7D6..D0
 
 #define WP_shift 8
 #define WP_mask (0x1<<WP_shift)	// connected at D8
@@ -114,17 +168,269 @@ FORCE_INLINE inline  uint32_t timer_diff()
 #define RB_shift 14
 #define RB_mask (0x1<<RB_shift) // connected to D14
 
+// transfer lengths that have their own unrolled kernel in send_data() and get_data()
+// .. full page, page with spare, spare only and the two usual ECC codeword sizes
+// .. these must stay plain numbers since they are pasted into the kernel names
+#define TRANSFER_SIZE_PAGE 8192
+#define TRANSFER_SIZE_PAGE_SPARE 8936
+#define TRANSFER_SIZE_SPARE 744
+#define TRANSFER_SIZE_CODEWORD_512 512
+#define TRANSFER_SIZE_CODEWORD_1024 1024
+
+// all the pins that the NIOS drives
+#define OUTPUT_PINS_mask (DQ_mask+CLE_mask+ALE_mask+WP_mask+RE_mask+WE_mask+CE_mask)
+
+// port driver layer
+// .. every access to the parallel port goes through the functions below
+// .. the value last written to the data register is kept in port_shadow
+// .. .. so a pin change is computed from the shadow and written with a single store
+// .. .. instead of a load + store (read-modify-write) on the uncached PIO
+// .. the same is done for the direction register with port_direction_shadow
+extern uint32_t port_shadow;
+extern uint32_t port_direction_shadow;
+
+#if PORT_PROFILE
+// number of port accesses since the last call to port_counter_reset()
+typedef struct
+{
+	uint32_t loads;
+	uint32_t stores;
+}port_access_count;
+
+extern port_access_count port_counter;
+
+#define PORT_COUNT_LOAD port_counter.loads++
+#define PORT_COUNT_STORE port_counter.stores++
+#else
+#define PORT_COUNT_LOAD
+#define PORT_COUNT_STORE
+#endif
+
+#if HOST_SIMULATION
+// these are provided by the host side model of the NAND device
+void host_port_write(uint32_t value);
+uint32_t host_port_read();
+void host_port_direction_write(uint32_t value);
+// .. moves the virtual clock by the time of the given number of CPU cycles
+void host_delay_cycles(uint16_t cycles);
+#endif
+
+#if TIMING_CHECK
+// these are provided by the timing checker (nand_timing_check.c)
+#define TIMING_EVENT_STORE 1
+#define TIMING_EVENT_READ 2
+#define TIMING_EVENT_DIRECTION 3
+#define TIMING_EVENT_MARK 4
+// .. records an access right before it is made
+void timing_capture(uint8_t kind, uint32_t value);
+// .. gives the value of the read recorded last
+void timing_capture_read(uint32_t value);
+#endif
+
+// function port_store()
+// .. writes the full value of the data register without updating the shadow
+// .. only for the streaming loops, the shadow must be brought back with port_write() afterwards
+FORCE_INLINE inline void port_store(uint32_t value)
+{
+	PORT_COUNT_STORE;
+#if TIMING_CHECK
+	timing_capture(TIMING_EVENT_STORE,value);
+#endif
+#if HOST_SIMULATION
+	host_port_write(value);
+#else
+	*(volatile uint32_t*)JUMPER_LOCATION = value;
+#endif
+}
+
+// function port_write()
+// .. writes the full value of the data register in one store
+FORCE_INLINE inline void port_write(uint32_t value)
+{
+	port_shadow = value;
+	port_store(value);
+}
+
+// function port_read()
+// .. reads the pin values, only needed for R/B# and for DQ when they are inputs
+FORCE_INLINE inline uint32_t port_read()
+{
+	PORT_COUNT_LOAD;
+#if TIMING_CHECK
+	timing_capture(TIMING_EVENT_READ,0);
+#endif
+#if HOST_SIMULATION
+	uint32_t value = host_port_read();
+#else
+	uint32_t value = *(volatile uint32_t*)JUMPER_LOCATION;
+#endif
+#if TIMING_CHECK
+	timing_capture_read(value);
+#endif
+	return value;
+}
+
+// function port_direction_write()
+// .. writes the full value of the direction register in one store
+FORCE_INLINE inline void port_direction_write(uint32_t value)
+{
+	port_direction_shadow = value;
+	PORT_COUNT_STORE;
+#if TIMING_CHECK
+	timing_capture(TIMING_EVENT_DIRECTION,value);
+#endif
+#if HOST_SIMULATION
+	host_port_direction_write(value);
+#else
+	*(volatile uint32_t*)JUMPER_DIRECTION = value;
+#endif
+}
+
+// function port_idle_value()
+// .. value of the port with CE#, RE# and WE# high, ALE, CLE and DQ low
+// .. WP# is the only pin carried over from the current state
+FORCE_INLINE inline uint32_t port_idle_value()
+{
+	return (port_shadow & WP_mask)|CE_mask|RE_mask|WE_mask;
+}
 
-#define SAMPLE_TIME asm("nop");asm("nop")
-#define HOLD_TIME {asm("nop");}
-// 100ns
-#define tWW asm("nop");asm("nop");asm("nop");asm("nop");asm("nop");asm("nop");asm("nop");asm("nop");asm("nop");asm("nop")
-#define tWB {asm("nop"); asm("nop");}
-#define tRR {for(uint8_t i=0;i<4;i++) asm("nop");}
-#define tRHW tWB
-#define tCCS tWB
-#define tADL tWB
-#define tWHR {for(uint8_t i=0;i<12;i++) asm("nop");} // .. tWHR = 120ns
+// function wait_ready()
+// .. spins until R/B# reads high
+FORCE_INLINE inline void wait_ready()
+{
+	while((port_read() & RB_mask)==0);
+}
+
+#if PORT_PROFILE
+// resets the load/store counters
+// .. call this right before the operation to be measured
+void port_counter_reset();
+
+// prints the number of loads and stores since port_counter_reset()
+void port_counter_report(const char* operation_name);
+#endif
+
+
+// timing engine
+// .. every wait on the bus is the minimum legal time of the ONFI asynchronous timing mode in use
+// .. .. turned in to CPU cycles with CPU_CLOCK_MHZ
+// .. with NAND_TIMING_MODE set to 0..5 the waits are compile-time constants for that mode
+// .. with NAND_TIMING_MODE set to TIMING_MODE_RUNTIME they are read from nand_timing
+// .. .. which is filled by timing_configure() (and set_timing_mode() on the device)
+#define CPU_CLOCK_MHZ 100
+
+#define TIMING_MODE_RUNTIME (-1)
+#ifndef NAND_TIMING_MODE
+#define NAND_TIMING_MODE TIMING_MODE_RUNTIME
+#endif
+
+// cycles a port store takes before the next instruction runs
+// .. this time already counts towards every wait, so it is taken off the computed wait
+// .. leave it at 0 to keep the waits conservative
+#define PORT_ACCESS_CYCLES 0
+
+// ONFI asynchronous timings in ns for modes 0..5
+#define ONFI_MODE_VALUE(mode,m0,m1,m2,m3,m4,m5) ((mode)==0?(m0):(mode)==1?(m1):(mode)==2?(m2):(mode)==3?(m3):(mode)==4?(m4):(m5))
+#define ONFI_tDS_ns(mode) ONFI_MODE_VALUE(mode,40,20,15,10,10,7)
+#define ONFI_tDH_ns(mode) ONFI_MODE_VALUE(mode,20,10,5,5,5,5)
+#define ONFI_tWP_ns(mode) ONFI_MODE_VALUE(mode,50,25,17,15,12,10)
+#define ONFI_tWH_ns(mode) ONFI_MODE_VALUE(mode,30,15,15,10,10,7)
+#define ONFI_tREA_ns(mode) ONFI_MODE_VALUE(mode,40,30,25,20,20,16)
+#define ONFI_tRP_ns(mode) ONFI_MODE_VALUE(mode,50,25,17,15,12,10)
+#define ONFI_tREH_ns(mode) ONFI_MODE_VALUE(mode,30,15,15,10,10,7)
+#define ONFI_tWB_ns(mode) ONFI_MODE_VALUE(mode,200,100,100,100,100,100)
+#define ONFI_tWHR_ns(mode) ONFI_MODE_VALUE(mode,120,80,80,60,60,60)
+#define ONFI_tRR_ns(mode) ONFI_MODE_VALUE(mode,40,20,20,20,20,20)
+#define ONFI_tADL_ns(mode) ONFI_MODE_VALUE(mode,200,100,100,100,70,70)
+#define ONFI_tRHW_ns(mode) ONFI_MODE_VALUE(mode,200,100,100,100,100,100)
+#define ONFI_tCS_ns(mode) ONFI_MODE_VALUE(mode,70,35,25,25,20,15)
+#define ONFI_tCLS_ns(mode) ONFI_MODE_VALUE(mode,50,25,15,10,10,10)
+#define ONFI_tALS_ns(mode) ONFI_MODE_VALUE(mode,50,25,15,10,10,10)
+// .. covered by the waits above, only looked at by the timing checker
+#define ONFI_tCH_ns(mode) ONFI_MODE_VALUE(mode,20,10,10,5,5,5)
+#define ONFI_tCLH_ns(mode) ONFI_MODE_VALUE(mode,20,10,10,5,5,5)
+#define ONFI_tALH_ns(mode) ONFI_MODE_VALUE(mode,20,10,10,5,5,5)
+#define ONFI_tWC_ns(mode) ONFI_MODE_VALUE(mode,100,45,35,30,25,20)
+#define ONFI_tRC_ns(mode) ONFI_MODE_VALUE(mode,100,50,35,30,25,20)
+// .. tCCS is given by the parameter page, this one is used until it is read
+#define ONFI_tCCS_ns 200
+#define ONFI_tWW_ns 100
+
+#define TIMING_MAX(a,b) ((a)>(b)?(a):(b))
+// wait of the first latch cycle after CE# goes low, CLE or ALE go high in the same store
+#define ONFI_FIRST_LATCH_ns(mode) TIMING_MAX(TIMING_MAX(ONFI_tDS_ns(mode),ONFI_tWP_ns(mode)),\
+								TIMING_MAX(ONFI_tCS_ns(mode),TIMING_MAX(ONFI_tCLS_ns(mode),ONFI_tALS_ns(mode))))
+#define NS_TO_CYCLES(ns) ((((ns)*CPU_CLOCK_MHZ)+999)/1000)
+#define WAIT_CYCLES(ns) (NS_TO_CYCLES(ns)>PORT_ACCESS_CYCLES?NS_TO_CYCLES(ns)-PORT_ACCESS_CYCLES:0)
+
+// wait cycles of the timing mode in use
+// .. ds also covers tWP (WE# low), dh covers tWH (WE# high)
+// .. cs replaces ds in the first latch cycle after CE# goes low: it also covers tCS, tCLS and tALS
+// .. rea also covers tRP (RE# low)
+typedef struct
+{
+	uint8_t mode;
+	uint16_t ds;
+	uint16_t cs;
+	uint16_t dh;
+	uint16_t rea;
+	uint16_t reh;
+	uint16_t wb;
+	uint16_t whr;
+	uint16_t rr;
+	uint16_t adl;
+	uint16_t ccs;
+	uint16_t rhw;
+	uint16_t ww;
+}nand_timing_cycles;
+
+extern nand_timing_cycles nand_timing;
+
+// function delay_cycles()
+// .. spins for at least the given number of cycles
+FORCE_INLINE inline void delay_cycles(uint16_t cycles)
+{
+#if HOST_SIMULATION
+	host_delay_cycles(cycles);
+#else
+	for(;cycles>0;cycles--)
+	{
+		asm volatile("nop");
+	}
+#endif
+}
+
+#if NAND_TIMING_MODE==TIMING_MODE_RUNTIME
+#define tDS delay_cycles(nand_timing.ds)
+#define tCS delay_cycles(nand_timing.cs)
+#define tDH delay_cycles(nand_timing.dh)
+#define tREA delay_cycles(nand_timing.rea)
+#define tREH delay_cycles(nand_timing.reh)
+#define tWB delay_cycles(nand_timing.wb)
+#define tWHR delay_cycles(nand_timing.whr)
+#define tRR delay_cycles(nand_timing.rr)
+#define tADL delay_cycles(nand_timing.adl)
+#define tCCS delay_cycles(nand_timing.ccs)
+#define tRHW delay_cycles(nand_timing.rhw)
+#define tWW delay_cycles(nand_timing.ww)
+#else
+#define tDS delay_cycles(WAIT_CYCLES(TIMING_MAX(ONFI_tDS_ns(NAND_TIMING_MODE),ONFI_tWP_ns(NAND_TIMING_MODE))))
+#define tCS delay_cycles(WAIT_CYCLES(ONFI_FIRST_LATCH_ns(NAND_TIMING_MODE)))
+#define tDH delay_cycles(WAIT_CYCLES(TIMING_MAX(ONFI_tDH_ns(NAND_TIMING_MODE),ONFI_tWH_ns(NAND_TIMING_MODE))))
+#define tREA delay_cycles(WAIT_CYCLES(TIMING_MAX(ONFI_tREA_ns(NAND_TIMING_MODE),ONFI_tRP_ns(NAND_TIMING_MODE))))
+#define tREH delay_cycles(WAIT_CYCLES(ONFI_tREH_ns(NAND_TIMING_MODE)))
+#define tWB delay_cycles(WAIT_CYCLES(ONFI_tWB_ns(NAND_TIMING_MODE)))
+#define tWHR delay_cycles(WAIT_CYCLES(ONFI_tWHR_ns(NAND_TIMING_MODE)))
+#define tRR delay_cycles(WAIT_CYCLES(ONFI_tRR_ns(NAND_TIMING_MODE)))
+#define tADL delay_cycles(WAIT_CYCLES(ONFI_tADL_ns(NAND_TIMING_MODE)))
+#define tCCS delay_cycles(WAIT_CYCLES(ONFI_tCCS_ns))
+#define tRHW delay_cycles(WAIT_CYCLES(ONFI_tRHW_ns(NAND_TIMING_MODE)))
+#define tWW delay_cycles(WAIT_CYCLES(ONFI_tWW_ns))
+#endif
+
+// older names of the data setup/hold waits
+#define SAMPLE_TIME tDS
+#define HOLD_TIME tDH
 
 
 // put the user defined header codes here
@@ -185,6 +491,13 @@ void send_address(uint8_t address_to_send);
 // .. make WE low and repeat the procedure again for number of bytes required (int num_data)
 void send_data(uint8_t* data_to_send,uint16_t num_data);
 
+// function that builds the lookup table used by send_data()
+// .. for every byte value the table holds the two port words of a data-in cycle
+// .. .. [0]: WE# low with the byte on DQ, [1]: WE# high with the byte still on DQ
+// .. .. CE# low, ALE/CLE low, RE# high and the current WP# are folded in
+// .. send_data() calls this by itself whenever WP# differs from the one the table was built with
+void build_bus_write_lut();
+
 // function to receive data from the NAND device
 // .. data can be received when on ready state (RDY signal)
 // .. data can be received following READ operation
@@ -196,6 +509,11 @@ void send_data(uint8_t* data_to_send,uint16_t num_data);
 // .. .. data is available at DQ pins on the falling edge of RE pin (RE is also input to NAND)
 void get_data(uint8_t* data_received,uint16_t num_data);
 
+// same as get_data() but without waiting for R/B#
+// .. R/B# is shared by all the LUNs, so this is the one to use for status reads
+// .. .. and for data output of one LUN while another LUN is busy
+void get_data_while_busy(uint8_t* data_received,uint16_t num_data);
+
 // .. .. data is available at DQ pins on the falling edge of RE pin (RE is also input to NAND)
 void get_data_fast(uint8_t* data_received,uint16_t num_data);
 
@@ -217,6 +535,28 @@ void disable_erase();
 void write_enable();
 void enable_erase();
 
+// function that fills nand_timing for the given timing mode and CPU clock
+// .. tCCS is taken from device_geometry if the parameter page gave one
+// .. only changes the waits of the host, see set_timing_mode() for the device
+void timing_configure(uint8_t mode, uint16_t cpu_mhz);
+
+// function to write the 4 parameters of a feature
+// .. command 0xEF, feature address, tADL, P1..P4, then tWB and R/B#
+void set_features(uint8_t feature_address, uint8_t* parameters);
+
+// function to read the 4 parameters of a feature
+// .. command 0xEE, feature address, tWB, R/B#, tRR, P1..P4
+void get_features(uint8_t feature_address, uint8_t* parameters);
+
+// function that returns the fastest asynchronous timing mode supported by the device
+// .. from device_geometry.timing_modes, or NAND_TIMING_MODE when that is fixed
+uint8_t fastest_timing_mode();
+
+// function to switch the device and the host to the given timing mode
+// .. issues SET FEATURES on feature 0x01 (timing mode) and then calls timing_configure()
+// .. returns false if the device does not support the mode
+bool set_timing_mode(uint8_t mode);
+
 // function to initialize the NAND device
 // .. following are the tasks to be performed for initialization of NAND device
 // .. provide Vcc (ie ramp Vcc)
@@ -254,10 +594,71 @@ void reset_LUN(uint8_t* address_LUN, uint8_t num_address_bytes);
 void read_manufacturer_id(uint8_t* device_id_array);
 
 // function that reads the device ID and tries to detect the device name
-// .. call the function device_id at address 00h
-// .. lookup table based finding for device name
+// .. the model name from the parameter page is used when device_geometry was read from the device
+// .. otherwise the ID is looked up in a small table of known parts
 void detect_device();
 
+// geometry and timing of the NAND device
+// .. filled from the ONFI parameter page by read_parameter_page()
+// .. until then it holds the values of MT29F64G08CBABA
+// .. all the data-path functions size their transfers and addresses from device_geometry
+typedef struct
+{
+	bool from_parameter_page;		// false if these are the built-in defaults
+	char manufacturer[13];
+	char model[21];
+	uint8_t manufacturer_id;
+	uint16_t page_size;				// data bytes per page
+	uint16_t spare_size;			// spare bytes per page
+	uint32_t pages_per_block;
+	uint32_t blocks_per_lun;
+	uint8_t num_luns;
+	uint8_t num_planes;
+	uint8_t column_address_cycles;
+	uint8_t row_address_cycles;
+	uint8_t bits_per_cell;
+	uint16_t timing_modes;			// bit n is set if asynchronous timing mode n is supported
+	uint16_t t_prog_us;				// maximum page program time
+	uint16_t t_bers_us;				// maximum block erase time
+	uint16_t t_r_us;				// maximum page read time
+	uint16_t t_ccs_ns;				// minimum change column setup time
+	// .. derived values
+	uint8_t page_bits;				// row address bits for the page in block
+	uint8_t block_bits;				// row address bits for the block in LUN
+}nand_geometry;
+
+extern nand_geometry device_geometry;
+
+// crc used by the ONFI parameter page
+// .. polynomial x16+x15+x2+1 (0x8005), initial value 0x4F4E, no reflection
+uint16_t onfi_crc16(uint8_t* data, uint16_t len);
+
+// function to read the ONFI parameter page
+// .. command 0xEC with address 0x00, then tR before the 256-byte page can be read
+// .. the device keeps at least three copies one after the other
+// .. .. the copies are read one by one until the CRC-16 of one matches
+// .. returns true and fills geometry if a valid copy was found, geometry is untouched otherwise
+bool read_parameter_page(nand_geometry* geometry);
+
+// total number of address cycles for an operation that takes column and row address
+FORCE_INLINE inline uint8_t full_address_cycles()
+{
+	return device_geometry.column_address_cycles+device_geometry.row_address_cycles;
+}
+
+// following function creates the row address of a page
+// .. row_address should have space for device_geometry.row_address_cycles bytes
+// .. layout is page bits, then block bits, then LUN bits (LSB first)
+void make_row_address(uint8_t lun, uint32_t block, uint32_t page, uint8_t* row_address);
+
+// following function creates the full address of a page (column bytes followed by the row bytes)
+// .. address should have space for full_address_cycles() bytes
+void make_page_address(uint8_t lun, uint32_t block, uint32_t page, uint16_t column, uint8_t* address);
+
+// following function splits a row address back in to lun, block and page
+// .. any of the output pointers can be NULL
+void split_row_address(uint8_t* row_address, uint8_t* lun, uint32_t* block, uint32_t* page);
+
 // function to read the 4-byte ONFI code
 // when read from address 00h, it returns 4-byte ONFI code
 // follow the following sequences
@@ -291,14 +692,114 @@ void read_status(uint8_t* status_value);
 void read_status_enhanced(uint8_t* status_value, uint8_t* r1r2r3);
 
 // write a function to perform an read operation
+// .. if the page is still in the data register of its LUN from the last read (TRACK_CACHE_REGISTER)
+// .. .. only the column is changed (0x05-0xE0, or 0x06-0xE0 with more than one LUN) and there is no tR
 void read_page(uint8_t* address,uint8_t address_length);
 
+// page held by the data register of each LUN
+// .. a page read records it, anything else that changes the register forgets it:
+// .. .. program, erase, multi-plane and cache operations, column changes for data input, resets,
+// .. .. the parameter page and the unique ID
+// .. a command sequence sent outside this driver must call cache_register_forget_all()
+#define CACHE_REGISTER_MAX_LUNS 4
+
+// number of read_page() calls that found their page in the data register
+extern uint32_t cache_register_hits;
+
+// function to forget the page in the data register of the LUN of row_address
+void cache_register_forget(uint8_t* row_address);
+
+// function to forget the pages of all LUNs
+void cache_register_forget_all();
+
 void read_page_cache_sequential(uint8_t* address, uint8_t address_length,uint8_t* data_read,uint16_t* data_read_len,uint16_t num_pages);
 
+// gets each page of a cache read stream as soon as it is in RAM
+// .. it runs while the device is already reading the next page in to its data register
+// .. data stays valid until the ring slot comes around again (num_slots pages later)
+typedef void (*page_consumer)(uint32_t page_index, uint8_t* row_address, uint8_t* data, void* context);
+
+// ring of page buffers for the cache read streams
+// .. buffer holds num_slots slots of page_len bytes, page i goes to slot i%num_slots
+// .. page_len bytes are clocked out of each page from column (a column change is made if it is not 0)
+// .. consumer can be NULL, then the ring must be as large as the read
+typedef struct
+{
+	uint8_t* buffer;
+	uint32_t num_slots;
+	uint16_t page_len;
+	page_consumer consumer;
+	void* context;
+	uint16_t column;
+}page_ring;
+
+// moves row_address to the next page, at the end of a block to page 0 of the next block
+void next_row_address(uint8_t* row_address);
+
+// function to read num_pages consecutive pages from row_address with cache read (0x31/0x3F)
+// .. the pages go through the ring, so the whole read does not need to fit in RAM
+// .. when the stream crosses in to the next block a random cache read is used for that page
+void read_page_cache_stream(uint8_t* row_address, uint32_t num_pages, page_ring* ring);
+
+// same as above for any list of pages
+// .. row_addresses has num_pages row addresses one after the other
+// .. each next page is started with a random cache read (0x00 address 0x31)
+void read_page_cache_random(uint8_t* row_addresses, uint32_t num_pages, page_ring* ring);
+
+// function to collect the spare area of every page in a range of blocks
+// .. only oob_len bytes starting at oob_offset in the spare area are clocked out of each page
+// .. .. so the scan time goes with the spare bytes, not with the page size
+// .. metadata gets oob_len bytes per page, page after page (num_blocks*pages_per_block*oob_len bytes)
+// .. use_cache_read pipelines the page loads with the cache read stream
+void scan_spare_area(uint8_t lun, uint32_t first_block, uint32_t num_blocks, uint16_t oob_offset, uint16_t oob_len, uint8_t* metadata, bool use_cache_read);
+
 void change_read_column(uint8_t* col_address);
 
 void change_read_column_enhanced(uint8_t* address);
 
+// one piece of a vectored page read
+// .. len bytes from column of the page go straight to destination
+typedef struct
+{
+	uint16_t column;
+	uint16_t len;
+	uint8_t* destination;
+}read_segment;
+
+// gaps up to this many bytes between two segments are clocked out and dropped
+// .. instead of a column change, which costs more than that on the bus
+#define SCATTER_GAP_SKIP_BYTES 8
+
+// function to read several pieces of a page with one page load
+// .. the column bytes of address are not used, the segments give the columns
+// .. segments are sorted by column in place
+// .. the data goes directly in to each destination, there is no bounce buffer
+void read_page_vectored(uint8_t* address, read_segment* segments, uint8_t num_segments);
+
+// erased pages read as all 0xff, but an MLC page can show a few flipped bits right after the erase
+// .. a page with at most this many 0 bits over page and spare is taken as erased
+#ifndef BLANK_BITFLIP_THRESHOLD
+	#define BLANK_BITFLIP_THRESHOLD 8
+#endif
+
+// bytes checked at a time by blank_check_page
+#define BLANK_CHECK_CHUNK 256
+
+// number of 0 bits in len bytes of data
+// .. words of all 1 are skipped, the others are counted 32 bits at a time
+// .. stops counting once more than limit are found (the count returned is then only above limit)
+uint32_t count_zero_bits(uint8_t* data, uint32_t len, uint32_t limit);
+
+// true if len bytes of data have at most max_zero_bits 0 bits
+bool is_erased(uint8_t* data, uint32_t len, uint32_t max_zero_bits);
+
+// function to check that a page and its spare area are erased
+// .. address is column and row address, the column should be 0
+// .. the bytes are checked as they come off the bus, BLANK_CHECK_CHUNK at a time,
+// .. .. and the transfer stops at the first chunk that passes max_zero_bits
+// .. data gets the page and spare bytes when not NULL (only the part read if the page is not blank)
+bool blank_check_page(uint8_t* address, uint32_t max_zero_bits, uint8_t* data);
+
 void change_write_column(uint8_t* col_address);
 
 void change_row_address(uint8_t* address);
@@ -307,8 +808,140 @@ void read_mode();
 
 void program_page(uint8_t* address,uint8_t* data,uint16_t num_data);
 
+// bits of the status register
+#define STATUS_FAIL 0x01	// last operation failed
+#define STATUS_FAILC 0x02	// the operation before the last one failed (cache operations)
+#define STATUS_ARDY 0x20	// array is ready (no operation running)
+#define STATUS_RDY 0x40		// LUN is ready for the next command, the cache register is free
+#define STATUS_WP 0x80		// 1 when the device is not write protected
+
+// non-blocking operations
+// .. nand_submit_*() send the whole command sequence up to the confirm command and return a handle
+// .. .. so the CPU can do other work during tR, tPROG or tBERS
+// .. nand_poll() looks at R/B# once and returns true when the operation has finished
+// .. nand_wait() spins until it has finished, both give the status register value
+// .. .. a handle can be collected only once, the slot is free again after that
+// .. R/B# only tells about the last operation, so a submit first finishes the one running
+#define NAND_MAX_OPERATIONS 4
+#define NAND_INVALID_HANDLE 0xff
+#define MAX_ROW_ADDRESS_CYCLES 4
+#define MAX_COLUMN_ADDRESS_CYCLES 2
+#define MAX_ADDRESS_CYCLES (MAX_COLUMN_ADDRESS_CYCLES+MAX_ROW_ADDRESS_CYCLES)
+
+#define NAND_OP_NONE 0
+#define NAND_OP_READ 1
+#define NAND_OP_PROGRAM 2
+#define NAND_OP_ERASE 3
+#define NAND_OP_RESET 4
+
+typedef uint8_t nand_handle;
+
+typedef struct
+{
+	uint8_t type;		// one of NAND_OP_*, NAND_OP_NONE if the slot is free
+	bool done;
+	uint8_t status;		// status register value once done
+	uint8_t row_address[MAX_ROW_ADDRESS_CYCLES];
+	bool multi_plane;	// two-plane operation, the other plane is in row_address_b
+	uint8_t row_address_b[MAX_ROW_ADDRESS_CYCLES];
+	bool aborted;		// a reset was sent while it was running, status is STATUS_FAIL and the result unknown
+}nand_operation;
+
+extern nand_operation nand_operations[NAND_MAX_OPERATIONS];
+
+nand_handle nand_submit_read(uint8_t* address,uint8_t address_length);
+nand_handle nand_submit_program(uint8_t* address,uint8_t* data,uint16_t num_data);
+nand_handle nand_submit_erase(uint8_t* row_address);
+// .. a reset does not wait for the running operation, it aborts it (its handle is done with aborted set)
+nand_handle nand_submit_reset();
+
+// returns true and the status once the operation has finished, false if it is still running
+// .. status can be NULL
+bool nand_poll(nand_handle handle, uint8_t* status);
+
+// waits for the operation to finish and returns the status register value
+uint8_t nand_wait(nand_handle handle);
+
+// finishes the running operation, only to be called once R/B# is high
+void nand_complete(nand_handle handle);
+
+// waits for the running operation (if any) and finishes it
+// .. the operations that do not go through the handles call this first
+void nand_finish_running();
+
+// function called when a program or erase ends with STATUS_FAIL
+// .. type is NAND_OP_PROGRAM or NAND_OP_ERASE, row_address is the page or block that failed
+// .. for two-plane operations the planes are asked one by one (0x78) and each failed one is reported
+// .. it runs while the operation is being finished, so it must not start another operation
+typedef void (*nand_failure_hook)(uint8_t type, uint8_t* row_address, uint8_t status);
+
+// only one hook at a time, NULL removes it
+void nand_set_failure_hook(nand_failure_hook hook);
+
+// passes a failure on to the hook
+// .. for the paths that do not finish through nand_complete (cache program, scheduler)
+void nand_report_failure(uint8_t type, uint8_t* row_address, uint8_t status);
+
+// multi-plane operations
+// .. two pages (or blocks) in different planes of the same LUN share one tPROG, tBERS or tR
+// .. the plane is given by the lowest bits of the block address
+// .. a legal pair is in the same LUN, at the same page in block, and in different planes
+
+// returns the plane of a row address
+uint8_t plane_of(uint8_t* row_address);
+
+// returns true if the two row addresses can be used together in a multi-plane operation
+// .. for an erase only the LUN and plane matter, the page bits are zero anyway
+bool multi_plane_address_valid(uint8_t* row_address_a, uint8_t* row_address_b);
+
+// 0x80 address-a data-a 0x11, then 0x80 address-b data-b 0x10
+nand_handle nand_submit_program_multi_plane(uint8_t* address_a,uint8_t* data_a,uint8_t* address_b,uint8_t* data_b,uint16_t num_data);
+
+// 0x60 row-a 0x60 row-b 0xD0
+nand_handle nand_submit_erase_multi_plane(uint8_t* row_address_a,uint8_t* row_address_b);
+
+// 0x00 address-a 0x32, then 0x00 address-b 0x30
+nand_handle nand_submit_read_multi_plane(uint8_t* address_a,uint8_t* address_b);
+
+// blocking versions of the above, these return the status register value
+// .. an invalid pair is reported and gives STATUS_FAIL
+uint8_t program_page_multi_plane(uint8_t* address_a,uint8_t* data_a,uint8_t* address_b,uint8_t* data_b,uint16_t num_data);
+uint8_t erase_block_multi_plane(uint8_t* row_address_a,uint8_t* row_address_b);
+
+// reads both pages and clocks them out with 0x06-0xE0 column selects for each plane
+uint8_t read_page_multi_plane(uint8_t* address_a,uint8_t* data_a,uint8_t* address_b,uint8_t* data_b,uint16_t num_data);
+
+// command sequences of the array operations up to tWB after the confirm command
+// .. these do not look at R/B#, it is for the caller to know the LUN is ready
+// .. used by the submit functions above and by the multi-LUN scheduler
+void issue_page_read(uint8_t* address,uint8_t address_length);
+void issue_page_program(uint8_t* address,uint8_t* data,uint16_t num_data);
+void issue_block_erase(uint8_t* row_address);
+
 void program_page_cache(uint8_t* address,uint8_t* data,uint16_t num_data,uint8_t num_pages);
 
+// gives the data of page number page_index of a stream (0 is the first page)
+// .. called right before the data input of that page, so the page can be prepared late
+typedef uint8_t* (*page_producer)(uint32_t page_index, void* context);
+
+// called for each page of a stream whose program failed
+typedef void (*page_failure_handler)(uint32_t page_index, uint8_t* row_address, void* context);
+
+// polls the status register (0x70) until all the bits in ready_mask are set and returns it
+uint8_t wait_status(uint8_t ready_mask);
+
+// function to program num_pages consecutive pages with cache program, starting at row_address
+// .. each page gets its own data from producer, num_data bytes from column 0
+// .. the next page is loaded as soon as the cache register is free (status RDY)
+// .. .. while the array is still busy with the previous page (status ARDY)
+// .. the stream can cross block boundaries, each block ends with a 0x10
+// .. every failed page is given to on_failure (can be NULL), the number of failed pages is returned
+uint32_t program_page_cache_stream(uint8_t* row_address,uint32_t num_pages,uint16_t num_data,page_producer producer,page_failure_handler on_failure,void* context);
+
+// same as above with an array of page buffers
+// .. failed (can be NULL) gets one flag per page
+uint32_t program_pages_cache(uint8_t* row_address,uint8_t** pages,uint32_t num_pages,uint16_t num_data,bool* failed);
+
 void erase_block(uint8_t* row_address);
 
 void partial_erase_block(uint8_t* row_address, uint8_t lp_cnt);
@@ -0,0 +1,348 @@
+#include "nand_page_cache.h"
+
+page_cache_statistics page_cache_stats;
+
+#define PAGE_CACHE_EMPTY 0xffffffff
+
+// a slot: the page in it (lun, block and page as one number), its data and state
+// .. loaded is false for a page only written so far, its slot has the new bits but not the ones on the device
+// .. failed is set when its program failed or was refused, it is kept dirty until its block is erased
+typedef struct
+{
+	uint32_t page;
+	uint32_t last_use;
+	bool dirty;
+	bool loaded;
+	bool failed;
+	uint8_t* data;
+}page_cache_slot;
+
+page_cache_slot page_cache_slots[PAGE_CACHE_SLOTS];
+uint32_t page_cache_clock = 0;
+// the device page of an unloaded slot when it is read
+uint8_t* page_cache_scratch = NULL;
+// for each block the page after the last one programmed since its erase
+uint16_t* page_cache_next_page = NULL;
+
+bool page_cache_init()
+{
+	uint32_t num_blocks = device_geometry.num_luns*device_geometry.blocks_per_lun;
+
+	free(page_cache_next_page);
+	page_cache_next_page = (uint16_t*)calloc(num_blocks,sizeof(uint16_t));
+	free(page_cache_scratch);
+	page_cache_scratch = (uint8_t*)malloc(device_geometry.page_size);
+	for(uint16_t i=0;i<PAGE_CACHE_SLOTS;i++)
+	{
+		free(page_cache_slots[i].data);
+		page_cache_slots[i].data = (uint8_t*)malloc(device_geometry.page_size);
+		page_cache_slots[i].page = PAGE_CACHE_EMPTY;
+		page_cache_slots[i].dirty = false;
+		page_cache_slots[i].failed = false;
+		if(page_cache_slots[i].data==NULL || page_cache_scratch==NULL || page_cache_next_page==NULL)
+		{
+			printf("Not enough memory for the page cache\n");
+			return false;
+		}
+	}
+	memset(&page_cache_stats,0,sizeof(page_cache_stats));
+	return true;
+}
+
+uint32_t page_cache_number(uint8_t* row_address)
+{
+	uint8_t lun;
+	uint32_t block;
+	uint32_t page;
+
+	split_row_address(row_address,&lun,&block,&page);
+	return (lun*device_geometry.blocks_per_lun+block)*device_geometry.pages_per_block+page;
+}
+
+void page_cache_address(uint32_t number, uint16_t column, uint8_t* address)
+{
+	uint32_t block = number/device_geometry.pages_per_block;
+
+	make_page_address(block/device_geometry.blocks_per_lun,block%device_geometry.blocks_per_lun,number%device_geometry.pages_per_block,column,address);
+}
+
+// true if the page has not been programmed since its block was erased, nor any page after it in the block
+bool page_cache_programmable(uint32_t number)
+{
+	return number%device_geometry.pages_per_block>=page_cache_next_page[number/device_geometry.pages_per_block];
+}
+
+// reads a whole page from the device
+void page_cache_load(uint32_t number, uint8_t* data)
+{
+	uint8_t address[MAX_ADDRESS_CYCLES];
+
+	page_cache_address(number,0,address);
+	read_page(address,full_address_cycles());
+	get_data_while_busy(data,device_geometry.page_size);
+}
+
+// programs the slots (all dirty), consecutive pages of a LUN together with cache program
+// .. slots is sorted here, the pages that would break the order of their block are refused
+// .. a slot stays dirty and is marked failed if its program is refused or fails
+uint32_t page_cache_program(uint16_t* slots, uint16_t num_slots)
+{
+	uint8_t* pages[PAGE_CACHE_SLOTS];
+	bool run_failed[PAGE_CACHE_SLOTS];
+	uint32_t failed = 0;
+	uint16_t num_allowed = 0;
+
+	for(uint16_t i=1;i<num_slots;i++)
+	{
+		uint16_t slot = slots[i];
+		uint16_t j = i;
+		for(;j>0 && page_cache_slots[slots[j-1]].page>page_cache_slots[slot].page;j--)
+		{
+			slots[j] = slots[j-1];
+		}
+		slots[j] = slot;
+	}
+
+	// in page order, so each page allowed moves the next page of its block past it
+	for(uint16_t i=0;i<num_slots;i++)
+	{
+		uint32_t number = page_cache_slots[slots[i]].page;
+
+		if(!page_cache_programmable(number))
+		{
+			printf("Page %lu is programmed already or out of order, not programmed again\n",(unsigned long)number);
+			page_cache_slots[slots[i]].failed = true;
+			failed++;
+			continue;
+		}
+		page_cache_next_page[number/device_geometry.pages_per_block] = number%device_geometry.pages_per_block+1;
+		slots[num_allowed++] = slots[i];
+	}
+
+	for(uint16_t first=0;first<num_allowed;)
+	{
+		uint32_t number = page_cache_slots[slots[first]].page;
+		uint32_t pages_per_lun = device_geometry.blocks_per_lun*device_geometry.pages_per_block;
+		uint16_t run = 1;
+
+		while(first+run<num_allowed && page_cache_slots[slots[first+run]].page==number+run && (number+run)%pages_per_lun!=0)
+		{
+			run++;
+		}
+		if(run==1)
+		{
+			uint8_t address[MAX_ADDRESS_CYCLES];
+
+			page_cache_address(number,0,address);
+			run_failed[0] = nand_wait(nand_submit_program(address,page_cache_slots[slots[first]].data,device_geometry.page_size))&STATUS_FAIL;
+		}else
+		{
+			uint8_t address[MAX_ADDRESS_CYCLES];
+
+			for(uint16_t i=0;i<run;i++)
+			{
+				pages[i] = page_cache_slots[slots[first+i]].data;
+			}
+			page_cache_address(number,0,address);
+			program_pages_cache(address+device_geometry.column_address_cycles,pages,run,device_geometry.page_size,run_failed);
+			page_cache_stats.cache_programs++;
+		}
+		for(uint16_t i=0;i<run;i++)
+		{
+			page_cache_slot* slot = &page_cache_slots[slots[first+i]];
+
+			if(run_failed[i])
+			{
+				slot->failed = true;
+				failed++;
+			}else
+			{
+				slot->dirty = false;
+			}
+		}
+		page_cache_stats.pages_flushed += run;
+		first += run;
+	}
+	page_cache_stats.failed_pages += failed;
+	return failed;
+}
+
+// slot of a page, PAGE_CACHE_SLOTS if it is not cached
+uint16_t page_cache_find(uint32_t number)
+{
+	for(uint16_t i=0;i<PAGE_CACHE_SLOTS;i++)
+	{
+		if(page_cache_slots[i].page==number)
+		{
+			return i;
+		}
+	}
+	return PAGE_CACHE_SLOTS;
+}
+
+// empties the least recently used slot and gives it to a page, PAGE_CACHE_SLOTS if none can be emptied
+// .. a dirty victim is programmed with the dirty pages before it in its block (they have to go first)
+// .. .. and the dirty pages right after it
+// .. failed slots are never taken, if the victim fails now nothing is given
+uint16_t page_cache_replace(uint32_t number)
+{
+	uint16_t victim = PAGE_CACHE_SLOTS;
+
+	for(uint16_t i=0;i<PAGE_CACHE_SLOTS;i++)
+	{
+		if(page_cache_slots[i].page==PAGE_CACHE_EMPTY)
+		{
+			victim = i;
+			break;
+		}
+		if(!page_cache_slots[i].failed && (victim==PAGE_CACHE_SLOTS || page_cache_slots[i].last_use<page_cache_slots[victim].last_use))
+		{
+			victim = i;
+		}
+	}
+	if(victim==PAGE_CACHE_SLOTS)
+	{
+		printf("Page cache has only failed pages\n");
+		return PAGE_CACHE_SLOTS;
+	}
+	if(page_cache_slots[victim].dirty)
+	{
+		uint16_t run[PAGE_CACHE_SLOTS];
+		uint16_t num_run = 0;
+		uint32_t first = page_cache_slots[victim].page/device_geometry.pages_per_block*device_geometry.pages_per_block;
+		uint16_t slot;
+
+		for(uint16_t i=0;i<PAGE_CACHE_SLOTS;i++)
+		{
+			page_cache_slot* other = &page_cache_slots[i];
+			if(other->dirty && !other->failed && other->page!=PAGE_CACHE_EMPTY && other->page>=first && other->page<=page_cache_slots[victim].page)
+			{
+				run[num_run++] = i;
+			}
+		}
+		for(uint32_t next=page_cache_slots[victim].page+1;(slot = page_cache_find(next))<PAGE_CACHE_SLOTS && page_cache_slots[slot].dirty && !page_cache_slots[slot].failed;next++)
+		{
+			run[num_run++] = slot;
+		}
+		page_cache_program(run,num_run);
+		if(page_cache_slots[victim].dirty)
+		{
+			return PAGE_CACHE_SLOTS;
+		}
+	}
+	page_cache_slots[victim].page = number;
+	page_cache_slots[victim].dirty = false;
+	page_cache_slots[victim].failed = false;
+	return victim;
+}
+
+bool page_cache_read(uint8_t* row_address, uint16_t column, uint8_t* data, uint16_t len)
+{
+	uint32_t number = page_cache_number(row_address);
+	uint16_t slot = page_cache_find(number);
+
+	if(column+len>device_geometry.page_size)
+	{
+		printf("Page cache read past the end of the page\n");
+		return false;
+	}
+	if(slot==PAGE_CACHE_SLOTS)
+	{
+		page_cache_stats.read_misses++;
+		slot = page_cache_replace(number);
+		if(slot==PAGE_CACHE_SLOTS)
+		{
+			return false;
+		}
+		page_cache_load(number,page_cache_slots[slot].data);
+		page_cache_slots[slot].loaded = true;
+	}else
+	{
+		page_cache_stats.read_hits++;
+		// .. the device page of a failed slot is not what was meant, the slot is all there is
+		if(!page_cache_slots[slot].loaded && !page_cache_slots[slot].failed)
+		{
+			// what the device will hold once the slot is programmed
+			uint32_t* cached = (uint32_t*)page_cache_slots[slot].data;
+			uint32_t* device = (uint32_t*)page_cache_scratch;
+
+			page_cache_load(number,page_cache_scratch);
+			for(uint16_t i=0;i<device_geometry.page_size/4;i++)
+			{
+				cached[i] &= device[i];
+			}
+			page_cache_slots[slot].loaded = true;
+		}
+	}
+	page_cache_slots[slot].last_use = ++page_cache_clock;
+	memcpy(data,page_cache_slots[slot].data+column,len);
+	return true;
+}
+
+bool page_cache_write(uint8_t* row_address, uint16_t column, uint8_t* data, uint16_t len)
+{
+	uint32_t number = page_cache_number(row_address);
+	uint16_t slot = page_cache_find(number);
+
+	if(column+len>device_geometry.page_size)
+	{
+		printf("Page cache write past the end of the page\n");
+		return false;
+	}
+	// a dirty slot is not programmed yet (or it failed and keeps its data)
+	if((slot==PAGE_CACHE_SLOTS || !page_cache_slots[slot].dirty) && !page_cache_programmable(number))
+	{
+		printf("Page %lu needs an erase of its block before it is written\n",(unsigned long)number);
+		return false;
+	}
+	if(slot==PAGE_CACHE_SLOTS)
+	{
+		page_cache_stats.write_misses++;
+		slot = page_cache_replace(number);
+		if(slot==PAGE_CACHE_SLOTS)
+		{
+			return false;
+		}
+		memset(page_cache_slots[slot].data,0xff,device_geometry.page_size);
+		page_cache_slots[slot].loaded = false;
+	}else
+	{
+		page_cache_stats.write_hits++;
+	}
+	page_cache_slots[slot].last_use = ++page_cache_clock;
+	page_cache_slots[slot].dirty = true;
+	memcpy(page_cache_slots[slot].data+column,data,len);
+	return true;
+}
+
+uint32_t page_cache_flush()
+{
+	uint16_t dirty[PAGE_CACHE_SLOTS];
+	uint16_t num_dirty = 0;
+
+	for(uint16_t i=0;i<PAGE_CACHE_SLOTS;i++)
+	{
+		if(page_cache_slots[i].dirty)
+		{
+			dirty[num_dirty++] = i;
+		}
+	}
+	return page_cache_program(dirty,num_dirty);
+}
+
+void page_cache_erase_block(uint8_t* row_address)
+{
+	uint32_t first = page_cache_number(row_address)/device_geometry.pages_per_block*device_geometry.pages_per_block;
+
+	for(uint16_t i=0;i<PAGE_CACHE_SLOTS;i++)
+	{
+		if(page_cache_slots[i].page!=PAGE_CACHE_EMPTY && page_cache_slots[i].page-first<device_geometry.pages_per_block)
+		{
+			page_cache_slots[i].page = PAGE_CACHE_EMPTY;
+			page_cache_slots[i].dirty = false;
+			page_cache_slots[i].failed = false;
+		}
+	}
+	erase_block(row_address);
+	page_cache_next_page[first/device_geometry.pages_per_block] = 0;
+}
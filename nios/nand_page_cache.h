@@ -0,0 +1,59 @@
+/*
+File: nand_page_cache.h
+Description: Write-back page cache
+			.. PAGE_CACHE_SLOTS page-sized slots on the heap (SDRAM on the DE1-SoC), replaced least recently used first
+			.. reads and writes of any part of a page go to its slot, only a miss or a flush uses the bus
+			.. .. so many small writes to one page cost one page program
+			.. dirty pages are programmed on eviction and by page_cache_flush()
+			.. .. consecutive dirty pages go out together with cache program (program_pages_cache)
+			.. the data area of the pages only, the spare area is not cached
+			.. NAND programming can only clear bits, so a page that is written to without being read first
+			.. .. is not loaded: its slot starts at 0xff and a later read ANDs in the bytes on the device
+			.. each block has the number of the page after the last one programmed since its erase
+			.. .. a write to a page below it (programmed already, or an earlier page of the block) is refused
+			.. .. so every page is programmed once, in order, and the blocks are taken as erased by page_cache_init()
+			.. .. a dirty victim is programmed with the dirty pages before it in its block
+			.. a slot whose program failed stays dirty and is not evicted, page_cache_erase_block() drops it
+			.. Each of the functions declared here are defined in file nand_page_cache.c
+*/
+#ifndef nand_page_cache_h
+#define nand_page_cache_h
+
+#include "nand_interface_header.h"
+
+#ifndef PAGE_CACHE_SLOTS
+	#define PAGE_CACHE_SLOTS 16
+#endif
+
+typedef struct
+{
+	uint32_t read_hits;
+	uint32_t read_misses;
+	uint32_t write_hits;
+	uint32_t write_misses;
+	uint32_t pages_flushed;
+	uint32_t cache_programs;	// runs of consecutive pages programmed with cache program
+	uint32_t failed_pages;		// programs that failed or were refused
+}page_cache_statistics;
+
+extern page_cache_statistics page_cache_stats;
+
+// function to allocate the slots for the page size of the device, all empty
+bool page_cache_init();
+
+// function to read len bytes from column of the page at row_address
+// .. returns false if no slot could be freed for it
+bool page_cache_read(uint8_t* row_address, uint16_t column, uint8_t* data, uint16_t len);
+
+// function to write len bytes at column of the page at row_address, the page becomes dirty
+// .. returns false if the page cannot be programmed any more before an erase or no slot could be freed for it
+bool page_cache_write(uint8_t* row_address, uint16_t column, uint8_t* data, uint16_t len);
+
+// function to program all the dirty pages (barrier), returns the number of pages that failed
+// .. the ones refused or failed before are counted again
+uint32_t page_cache_flush();
+
+// function to drop the cached pages of the block at row_address (dirty ones too) and erase it
+void page_cache_erase_block(uint8_t* row_address);
+
+#endif
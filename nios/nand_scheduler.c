@@ -0,0 +1,137 @@
+#include "nand_scheduler.h"
+#include "nand_trace.h"
+
+// state of each LUN
+// .. queue[head] is the request that is running when busy is true
+typedef struct
+{
+	scheduler_request* queue[SCHEDULER_QUEUE_DEPTH];
+	uint8_t head;
+	uint8_t count;
+	bool busy;
+}scheduler_lun;
+
+scheduler_lun scheduler_luns[SCHEDULER_MAX_LUNS];
+
+void scheduler_init()
+{
+	memset(scheduler_luns,0,sizeof(scheduler_luns));
+}
+
+void scheduler_prepare(scheduler_request* request, uint8_t type, uint8_t* address, uint8_t* data, uint16_t num_data)
+{
+	request->type = type;
+	memcpy(request->address,address,full_address_cycles());
+	request->data = data;
+	request->num_data = num_data;
+	request->status = 0;
+	request->done = false;
+}
+
+uint8_t scheduler_lun_of(scheduler_request* request)
+{
+	uint8_t lun;
+	split_row_address(request->address+device_geometry.column_address_cycles,&lun,NULL,NULL);
+	return lun;
+}
+
+bool scheduler_submit(scheduler_request* request)
+{
+	uint8_t lun = scheduler_lun_of(request);
+	if(lun>=device_geometry.num_luns || lun>=SCHEDULER_MAX_LUNS)
+	{
+		printf("Scheduler: LUN %d does not exist\n",lun);
+		return false;
+	}
+
+	scheduler_lun* state = &scheduler_luns[lun];
+	if(state->count==SCHEDULER_QUEUE_DEPTH)
+	{
+		return false;
+	}
+	request->done = false;
+	state->queue[(state->head+state->count)%SCHEDULER_QUEUE_DEPTH] = request;
+	state->count++;
+	return true;
+}
+
+// sends the command sequence of the request at the head of the queue
+void scheduler_issue(scheduler_request* request)
+{
+	uint8_t* row_address = request->address+device_geometry.column_address_cycles;
+
+	// an operation submitted through the handles would be lost from R/B# otherwise
+	nand_finish_running();
+
+	switch(request->type)
+	{
+		case NAND_OP_READ:
+			issue_page_read(request->address,full_address_cycles());
+			break;
+		case NAND_OP_PROGRAM:
+			issue_page_program(request->address,request->data,request->num_data);
+			break;
+		case NAND_OP_ERASE:
+			issue_block_erase(row_address);
+			break;
+	}
+}
+
+bool scheduler_run()
+{
+	bool all_done = true;
+
+	for(uint8_t lun=0;lun<device_geometry.num_luns && lun<SCHEDULER_MAX_LUNS;lun++)
+	{
+		scheduler_lun* state = &scheduler_luns[lun];
+
+		if(state->busy)
+		{
+			scheduler_request* request = state->queue[state->head];
+			uint8_t status;
+
+			// one look at the status of this LUN only
+			read_status_enhanced(&status,request->address+device_geometry.column_address_cycles);
+			if((status&(STATUS_RDY|STATUS_ARDY))!=(STATUS_RDY|STATUS_ARDY))
+			{
+				all_done = false;
+				continue;
+			}
+
+			if(request->type==NAND_OP_READ)
+			{
+				// 0x06-0xE0 selects this LUN and the column again for data output
+				// .. the other LUNs can still be busy so R/B# is not looked at
+				change_read_column_enhanced(request->address);
+				get_data_while_busy(request->data,request->num_data);
+			}else if(status&STATUS_FAIL)
+			{
+				nand_report_failure(request->type,request->address+device_geometry.column_address_cycles,status);
+			}
+#if TIMER_PROFILE
+			trace_end(request->address+device_geometry.column_address_cycles,status);
+#endif
+			request->status = status;
+			request->done = true;
+
+			state->busy = false;
+			state->head = (state->head+1)%SCHEDULER_QUEUE_DEPTH;
+			state->count--;
+		}
+
+		if(state->count>0)
+		{
+			// the LUN is idle, start its next request
+			// .. for a program this streams the data while the other LUNs are busy
+			scheduler_issue(state->queue[state->head]);
+			state->busy = true;
+			all_done = false;
+		}
+	}
+	return all_done;
+}
+
+void scheduler_drain()
+{
+	while(!scheduler_run());
+}
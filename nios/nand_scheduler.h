@@ -0,0 +1,61 @@
+/*
+File: nand_scheduler.h
+Description: Multi-LUN scheduler for array operations (page read, page program, block erase)
+			.. each LUN has a small queue and at most one operation running
+			.. the LUNs are polled with READ STATUS ENHANCED (0x78) instead of R/B#,
+			.. .. since R/B# is shared by all the LUNs of the target
+			.. while one LUN is busy with tPROG/tBERS/tR the next LUN gets its command and data
+			.. the scheduler and the handle API (nand_submit_*) exclude each other
+			.. .. the operation left running by a handle is finished before a request is issued
+			.. .. but no handle may be submitted while the scheduler has a LUN busy (drain it first)
+			.. Each of the functions declared here are defined in file nand_scheduler.c
+*/
+#ifndef nand_scheduler_h
+#define nand_scheduler_h
+
+#include "nand_interface_header.h"
+
+#define SCHEDULER_MAX_LUNS 4
+#define SCHEDULER_QUEUE_DEPTH 8
+
+// one operation for the scheduler
+// .. the memory belongs to the caller and must stay valid until done is true
+// .. address is column and row address (full_address_cycles() bytes)
+// .. .. the LUN is taken from the LUN bits of the row address (LA0 is in the last address byte)
+// .. .. for an erase the column bytes are ignored
+// .. data is the data to program or the destination of a read
+typedef struct
+{
+	uint8_t type;		// NAND_OP_READ, NAND_OP_PROGRAM or NAND_OP_ERASE
+	uint8_t address[MAX_ADDRESS_CYCLES];
+	uint8_t* data;
+	uint16_t num_data;
+	uint8_t status;		// status register value once done
+	volatile bool done;
+}scheduler_request;
+
+// function to clear all the queues
+void scheduler_init();
+
+// function to fill a request
+void scheduler_prepare(scheduler_request* request, uint8_t type, uint8_t* address, uint8_t* data, uint16_t num_data);
+
+// function that returns the LUN a request goes to
+uint8_t scheduler_lun_of(scheduler_request* request);
+
+// function to queue a request on its LUN
+// .. nothing is sent to the device here, see scheduler_run()
+// .. returns false if the LUN does not exist or its queue is full
+bool scheduler_submit(scheduler_request* request);
+
+// function that makes one pass over all the LUNs
+// .. a busy LUN is polled once with 0x78, and if it is done its request is finished
+// .. .. (for a read the data is clocked out to request->data here)
+// .. an idle LUN gets the next request of its queue issued
+// .. returns true when all the queues are empty and no LUN is busy
+bool scheduler_run();
+
+// function that calls scheduler_run() until everything has finished
+void scheduler_drain();
+
+#endif
@@ -0,0 +1,195 @@
+#include "nand_script.h"
+
+const uint8_t script_read_page[] =
+{
+	SCRIPT_CMD(0x00),SCRIPT_ADDR_FULL(0),SCRIPT_CMD(0x30),
+	SCRIPT_DELAY(SCRIPT_tWB),SCRIPT_WAIT_RB,SCRIPT_DELAY(SCRIPT_tRR),
+	SCRIPT_DOUT(1,2),
+	SCRIPT_END
+};
+
+const uint8_t script_program_page[] =
+{
+	SCRIPT_CMD(0x80),SCRIPT_ADDR_FULL(0),SCRIPT_DELAY(SCRIPT_tADL),
+	SCRIPT_DIN(1,2),SCRIPT_CMD(0x10),
+	SCRIPT_DELAY(SCRIPT_tWB),SCRIPT_WAIT_RB,SCRIPT_STATUS_CHECK,
+	SCRIPT_END
+};
+
+const uint8_t script_erase_block[] =
+{
+	SCRIPT_CMD(0x60),SCRIPT_ADDR_ROW(0),SCRIPT_CMD(0xd0),
+	SCRIPT_DELAY(SCRIPT_tWB),SCRIPT_WAIT_RB,SCRIPT_STATUS_CHECK,
+	SCRIPT_END
+};
+
+const uint8_t script_read_onfi_id[] =
+{
+	SCRIPT_CMD(0x90),SCRIPT_ADDR1(0x20),SCRIPT_DELAY(SCRIPT_tWHR),
+	SCRIPT_DOUT(0,1),
+	SCRIPT_END
+};
+
+const uint8_t script_get_features[] =
+{
+	SCRIPT_CMD(0xee),SCRIPT_ADDR_VALUE(0),
+	SCRIPT_DELAY(SCRIPT_tWB),SCRIPT_WAIT_RB,SCRIPT_DELAY(SCRIPT_tRR),
+	SCRIPT_DOUT(1,2),
+	SCRIPT_END
+};
+
+const uint8_t script_set_features[] =
+{
+	SCRIPT_CMD(0xef),SCRIPT_ADDR_VALUE(0),SCRIPT_DELAY(SCRIPT_tADL),
+	SCRIPT_DIN(1,2),
+	SCRIPT_DELAY(SCRIPT_tWB),SCRIPT_WAIT_RB,
+	SCRIPT_END
+};
+
+// one of the bus waits of the timing engine
+FORCE_INLINE inline void script_delay(uint8_t wait)
+{
+	switch(wait)
+	{
+		case SCRIPT_tWB:
+			tWB;
+			break;
+		case SCRIPT_tWHR:
+			tWHR;
+			break;
+		case SCRIPT_tRR:
+			tRR;
+			break;
+		case SCRIPT_tADL:
+			tADL;
+			break;
+		case SCRIPT_tCCS:
+			tCCS;
+			break;
+		case SCRIPT_tRHW:
+			tRHW;
+			break;
+		default:
+			tWW;
+			break;
+	}
+}
+
+uint8_t script_run(const uint8_t* script, script_arg* args)
+{
+	uint8_t status = STATUS_RDY|STATUS_ARDY;
+
+	nand_finish_running();
+	cache_register_forget_all();
+
+	// port values of the latch cycles, CE# low from the first one to the next data transfer or wait
+	uint32_t idle = port_idle_value();
+	uint32_t command_cycle = (idle&~(CE_mask))|CLE_mask;
+	uint32_t address_cycle = (idle&~(CE_mask))|ALE_mask;
+	// .. true while the port is away from idle and the shadow is not up to date
+	bool latching = false;
+
+// one latch cycle: WE# low with the byte on DQ, tDS, WE# high to latch it, tDH
+// .. tCS instead of tDS when the cycle also takes CE# low
+#define SCRIPT_LATCH(cycle,byte) {\
+									uint32_t word = (cycle)|((byte)&DQ_mask);\
+									port_store(word&~(WE_mask));\
+									if(latching)\
+									{\
+										tDS;\
+									}else\
+									{\
+										tCS;\
+									}\
+									port_store(word);\
+									tDH;\
+									latching = true;\
+								}
+// back to idle before anything that goes through the shadow
+#define SCRIPT_IDLE {\
+						if(latching)\
+						{\
+							port_write(idle);\
+							latching = false;\
+						}\
+					}
+
+	while(true)
+	{
+		uint8_t op = *script++;
+
+		switch(op)
+		{
+			case SCRIPT_OP_END:
+				SCRIPT_IDLE;
+				return status;
+			case SCRIPT_OP_CMD:
+				SCRIPT_LATCH(command_cycle,script[0]);
+				script++;
+				break;
+			case SCRIPT_OP_ADDR:
+				for(uint8_t i=0;i<script[0];i++)
+				{
+					SCRIPT_LATCH(address_cycle,script[1+i]);
+				}
+				script += 1+script[0];
+				break;
+			case SCRIPT_OP_ADDR_FULL:
+			case SCRIPT_OP_ADDR_ROW:
+			case SCRIPT_OP_ADDR_COLUMN:
+			{
+				uint8_t* address = args[script[0]].pointer;
+				uint8_t count = (op==SCRIPT_OP_ADDR_FULL)?full_address_cycles():
+					(op==SCRIPT_OP_ADDR_ROW)?device_geometry.row_address_cycles:device_geometry.column_address_cycles;
+				for(uint8_t i=0;i<count;i++)
+				{
+					SCRIPT_LATCH(address_cycle,address[i]);
+				}
+				script++;
+				break;
+			}
+			case SCRIPT_OP_ADDR_VALUE:
+				SCRIPT_LATCH(address_cycle,args[script[0]].value);
+				script++;
+				break;
+			case SCRIPT_OP_DIN:
+				SCRIPT_IDLE;
+				send_data(args[script[0]].pointer,args[script[1]].value);
+				script += 2;
+				break;
+			case SCRIPT_OP_DOUT:
+				SCRIPT_IDLE;
+				get_data_while_busy(args[script[0]].pointer,args[script[1]].value);
+				script += 2;
+				break;
+			case SCRIPT_OP_WAIT_RB:
+				SCRIPT_IDLE;
+				wait_ready();
+				break;
+			case SCRIPT_OP_DELAY:
+				script_delay(script[0]);
+				script++;
+				break;
+			case SCRIPT_OP_DELAY_CYCLES:
+				delay_cycles(script[0]|(script[1]<<8));
+				script += 2;
+				break;
+			case SCRIPT_OP_STATUS_CHECK:
+				SCRIPT_LATCH(command_cycle,0x70);
+				SCRIPT_IDLE;
+				tWHR;
+				get_data_while_busy(&status,1);
+				if(status&STATUS_FAIL)
+				{
+					return status;
+				}
+				break;
+			default:
+				SCRIPT_IDLE;
+				printf("Unknown script opcode %d\n",op);
+				return STATUS_FAIL;
+		}
+	}
+#undef SCRIPT_LATCH
+#undef SCRIPT_IDLE
+}
@@ -0,0 +1,84 @@
+/*
+File: nand_script.h
+Description: Command scripts
+			.. a command sequence written as bytes, run by script_run() in one loop
+			.. .. the idle port value is worked out once and command and address cycles are two stores each
+			.. .. with CE# held low from one cycle to the next, the pins go idle only around data and waits
+			.. addresses, buffers and lengths come from an array of arguments, so one script serves every page
+			.. the SCRIPT_* macros below build a script as a constant array at compile time
+			.. .. a vendor sequence is one more array, no new C function is needed
+			.. a script runs on its own: it finishes the running operation first and forgets the data registers
+			.. .. (cache_register_forget_all()), it does not go through the handles or the failure hook
+			.. Each of the functions declared here are defined in file nand_script.c
+*/
+#ifndef nand_script_h
+#define nand_script_h
+
+#include "nand_interface_header.h"
+
+// opcodes, each followed by its operand bytes
+#define SCRIPT_OP_END 0				// end of the script
+#define SCRIPT_OP_CMD 1				// command: byte
+#define SCRIPT_OP_ADDR 2			// address cycles given in the script: count, bytes
+#define SCRIPT_OP_ADDR_FULL 3		// column and row address from an argument pointer: argument
+#define SCRIPT_OP_ADDR_ROW 4		// row address from an argument pointer: argument
+#define SCRIPT_OP_ADDR_COLUMN 5		// column address from an argument pointer: argument
+#define SCRIPT_OP_ADDR_VALUE 6		// one address cycle from an argument value: argument
+#define SCRIPT_OP_DIN 7				// data input: argument pointer, argument length
+#define SCRIPT_OP_DOUT 8			// data output without looking at R/B#: argument pointer, argument length
+#define SCRIPT_OP_WAIT_RB 9			// wait for R/B# high
+#define SCRIPT_OP_DELAY 10			// one of the bus waits: SCRIPT_tXX
+#define SCRIPT_OP_DELAY_CYCLES 11	// a wait not in the timing table: cycles low byte, high byte
+#define SCRIPT_OP_STATUS_CHECK 12	// 0x70 and the status byte, the script stops if it has STATUS_FAIL
+
+// waits for SCRIPT_OP_DELAY
+#define SCRIPT_tWB 0
+#define SCRIPT_tWHR 1
+#define SCRIPT_tRR 2
+#define SCRIPT_tADL 3
+#define SCRIPT_tCCS 4
+#define SCRIPT_tRHW 5
+#define SCRIPT_tWW 6
+
+// building blocks of a script
+#define SCRIPT_END SCRIPT_OP_END
+#define SCRIPT_CMD(command) SCRIPT_OP_CMD,(command)
+#define SCRIPT_ADDR1(byte) SCRIPT_OP_ADDR,1,(byte)
+#define SCRIPT_ADDR_FULL(argument) SCRIPT_OP_ADDR_FULL,(argument)
+#define SCRIPT_ADDR_ROW(argument) SCRIPT_OP_ADDR_ROW,(argument)
+#define SCRIPT_ADDR_COLUMN(argument) SCRIPT_OP_ADDR_COLUMN,(argument)
+#define SCRIPT_ADDR_VALUE(argument) SCRIPT_OP_ADDR_VALUE,(argument)
+#define SCRIPT_DIN(pointer,length) SCRIPT_OP_DIN,(pointer),(length)
+#define SCRIPT_DOUT(pointer,length) SCRIPT_OP_DOUT,(pointer),(length)
+#define SCRIPT_WAIT_RB SCRIPT_OP_WAIT_RB
+#define SCRIPT_DELAY(wait) SCRIPT_OP_DELAY,(wait)
+#define SCRIPT_DELAY_CYCLES(cycles) SCRIPT_OP_DELAY_CYCLES,((cycles)&0xff),(((cycles)>>8)&0xff)
+#define SCRIPT_STATUS_CHECK SCRIPT_OP_STATUS_CHECK
+
+// an argument of a script, pointers for addresses and buffers, values for lengths and single bytes
+typedef union
+{
+	uint8_t* pointer;
+	uint32_t value;
+}script_arg;
+
+// scripts of the standard operations, arguments as listed
+// .. page read and data output: address, data, length
+extern const uint8_t script_read_page[];
+// .. page program with status check: address, data, length
+extern const uint8_t script_program_page[];
+// .. block erase with status check: row address
+extern const uint8_t script_erase_block[];
+// .. read ID at address 0x20 (ONFI signature): data, length
+extern const uint8_t script_read_onfi_id[];
+// .. get features: feature address, data (4 bytes), length 4
+extern const uint8_t script_get_features[];
+// .. set features: feature address, data (4 bytes), length 4
+extern const uint8_t script_set_features[];
+
+// function to run a script
+// .. returns the status of the last SCRIPT_OP_STATUS_CHECK (STATUS_RDY|STATUS_ARDY if there was none)
+// .. .. STATUS_FAIL also for an unknown opcode
+uint8_t script_run(const uint8_t* script, script_arg* args);
+
+#endif
@@ -0,0 +1,909 @@
+#define _GNU_SOURCE
+#include "nand_simulator.h"
+
+#if HOST_SIMULATION
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+const nand_simulator_config simulator_default_config =
+{
+	.page_size = 8192,
+	.spare_size = 744,
+	.pages_per_block = 256,
+	.blocks_per_lun = 4096,
+	.num_luns = 1,
+	.num_planes = 2,
+	.t_r_us = 75,
+	.t_prog_us = 1300,
+	.t_bers_us = 3800,
+	.t_rst_us = 5,
+	.t_cbsy_us = 3,
+	.backing_file = NULL,
+};
+
+nand_simulator_statistics simulator_stats;
+
+// timer registers of the driver, the snapshot registers follow the virtual clock
+uint32_t host_timer_registers[6];
+// virtual time of the last timer_start()
+uint64_t simulator_timer_start = 0;
+
+// what RE# puts on DQ
+#define SIMULATOR_OUTPUT_NONE 0
+#define SIMULATOR_OUTPUT_STATUS 1
+#define SIMULATOR_OUTPUT_CACHE 2
+#define SIMULATOR_OUTPUT_BUFFER 3
+
+#define SIMULATOR_NO_PAGE 0xffffffff
+
+typedef struct
+{
+	uint8_t* cache;			// cache register
+	uint8_t* data;			// page (data) register
+	bool queued;			// multi-plane program waiting for the confirm of the last plane
+	uint32_t queued_page;
+}simulator_plane;
+
+typedef struct
+{
+	uint64_t ready_at;			// RDY
+	uint64_t array_ready_at;	// ARDY
+	bool fail;
+	bool fail_previous;
+	uint8_t plane;				// plane of the cache register used for data in and out
+	uint32_t data_page;			// page in the data register of the read plane
+	uint8_t read_plane;
+	simulator_plane planes[SIMULATOR_MAX_PLANES];
+}simulator_lun;
+
+nand_simulator_config simulator;
+uint8_t* simulator_array = NULL;
+uint64_t simulator_array_size = 0;
+int simulator_file = -1;
+uint8_t* simulator_failing = NULL;
+
+uint64_t simulator_time = 0;
+uint32_t simulator_last_port = 0;
+uint8_t simulator_dq = 0xff;
+
+simulator_lun simulator_luns[SIMULATOR_MAX_LUNS];
+uint8_t simulator_lun_selected = 0;
+
+uint8_t simulator_command = 0;
+uint8_t simulator_address[8];
+uint8_t simulator_num_address = 0;
+uint8_t simulator_previous_command = 0;
+
+uint8_t simulator_output = SIMULATOR_OUTPUT_NONE;
+uint32_t simulator_column = 0;
+uint8_t simulator_buffer[768];
+uint16_t simulator_buffer_len = 0;
+uint16_t simulator_buffer_position = 0;
+
+// page address of 0x00 (read) and 0x80 (program) cycles
+uint32_t simulator_read_page = SIMULATOR_NO_PAGE;
+uint32_t simulator_read_column = 0;
+uint32_t simulator_program_page = SIMULATOR_NO_PAGE;
+
+uint32_t simulator_erase_blocks[SIMULATOR_MAX_PLANES];
+uint8_t simulator_num_erase = 0;
+
+uint8_t simulator_features[256][4];
+uint8_t simulator_feature_address = 0;
+uint8_t simulator_feature_count = 0;
+
+uint8_t simulator_page_bits;
+uint8_t simulator_block_bits;
+
+uint8_t simulator_bits_for(uint32_t count)
+{
+	uint8_t bits = 0;
+	while((1u<<bits)<count)
+	{
+		bits++;
+	}
+	return bits;
+}
+
+FORCE_INLINE inline uint32_t simulator_page_length()
+{
+	return simulator.page_size+simulator.spare_size;
+}
+
+FORCE_INLINE inline uint32_t simulator_pages_per_lun()
+{
+	return simulator.pages_per_block*simulator.blocks_per_lun;
+}
+
+FORCE_INLINE inline uint8_t* simulator_page_bytes(uint32_t page_number)
+{
+	return simulator_array+(uint64_t)page_number*simulator_page_length();
+}
+
+// page number (over all the LUNs) of a row address
+uint32_t simulator_row_to_page(uint8_t* row)
+{
+	uint32_t value = 0;
+	for(uint8_t i=0;i<3;i++)
+	{
+		value |= (uint32_t)row[i]<<(8*i);
+	}
+	uint32_t page = value&((1u<<simulator_page_bits)-1);
+	uint32_t block = (value>>simulator_page_bits)&((1u<<simulator_block_bits)-1);
+	uint32_t lun = value>>(simulator_page_bits+simulator_block_bits);
+	if(lun>=simulator.num_luns || block>=simulator.blocks_per_lun || page>=simulator.pages_per_block)
+	{
+		printf("Simulator: row address out of range\n");
+		return 0;
+	}
+	return lun*simulator_pages_per_lun()+block*simulator.pages_per_block+page;
+}
+
+FORCE_INLINE inline uint8_t simulator_lun_of(uint32_t page_number)
+{
+	return page_number/simulator_pages_per_lun();
+}
+
+FORCE_INLINE inline uint8_t simulator_plane_of(uint32_t page_number)
+{
+	return (page_number/simulator.pages_per_block)%simulator.num_planes;
+}
+
+FORCE_INLINE inline bool simulator_block_failing(uint32_t page_number)
+{
+	uint32_t block = page_number/simulator.pages_per_block;
+	return (simulator_failing[block>>3]>>(block&7))&1;
+}
+
+// the array holds inverted bytes
+void simulator_array_read(uint32_t page_number, uint8_t* destination)
+{
+	uint8_t* source = simulator_page_bytes(page_number);
+	for(uint32_t i=0;i<simulator_page_length();i++)
+	{
+		destination[i] = ~source[i];
+	}
+}
+
+// a program can only clear bits
+void simulator_array_program(uint32_t page_number, uint8_t* source)
+{
+	uint8_t* destination = simulator_page_bytes(page_number);
+	for(uint32_t i=0;i<simulator_page_length();i++)
+	{
+		destination[i] |= ~source[i];
+	}
+	simulator_stats.page_programs++;
+}
+
+void simulator_array_erase(uint32_t block)
+{
+	uint64_t start = (uint64_t)block*simulator.pages_per_block*simulator_page_length();
+	uint64_t length = (uint64_t)simulator.pages_per_block*simulator_page_length();
+
+	if(simulator_file>=0)
+	{
+		fallocate(simulator_file,FALLOC_FL_PUNCH_HOLE|FALLOC_FL_KEEP_SIZE,start,length);
+	}else
+	{
+		// whole memory pages go back to the system, the edges are cleared
+		uint64_t page = sysconf(_SC_PAGESIZE);
+		uint64_t first = (start+page-1)&~(page-1);
+		uint64_t last = (start+length)&~(page-1);
+		if(last>first)
+		{
+			memset(simulator_array+start,0,first-start);
+			madvise(simulator_array+first,last-first,MADV_DONTNEED);
+			memset(simulator_array+last,0,start+length-last);
+		}else
+		{
+			memset(simulator_array+start,0,length);
+		}
+	}
+	simulator_stats.block_erases++;
+}
+
+uint8_t simulator_status(simulator_lun* lun)
+{
+	uint8_t status = 0;
+	if(simulator_last_port&WP_mask)
+	{
+		status |= STATUS_WP;
+	}
+	if(simulator_time>=lun->ready_at)
+	{
+		status |= STATUS_RDY;
+	}
+	if(simulator_time>=lun->array_ready_at)
+	{
+		status |= STATUS_ARDY;
+	}
+	if(lun->fail)
+	{
+		status |= STATUS_FAIL;
+	}
+	if(lun->fail_previous)
+	{
+		status |= STATUS_FAILC;
+	}
+	return status;
+}
+
+bool simulator_ready()
+{
+	for(uint8_t i=0;i<simulator.num_luns;i++)
+	{
+		if(simulator_time<simulator_luns[i].ready_at)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void simulator_set_buffer(const uint8_t* data, uint16_t len)
+{
+	memcpy(simulator_buffer,data,len);
+	simulator_buffer_len = len;
+	simulator_buffer_position = 0;
+	simulator_output = SIMULATOR_OUTPUT_BUFFER;
+}
+
+void simulator_put_u16(uint8_t* page, uint16_t offset, uint16_t value)
+{
+	page[offset] = value&0xff;
+	page[offset+1] = value>>8;
+}
+
+void simulator_put_u32(uint8_t* page, uint16_t offset, uint32_t value)
+{
+	simulator_put_u16(page,offset,value&0xffff);
+	simulator_put_u16(page,offset+2,value>>16);
+}
+
+// three copies of the parameter page
+void simulator_parameter_page()
+{
+	uint8_t page[256];
+
+	memset(page,0,sizeof(page));
+	memcpy(page,"ONFI",4);
+	simulator_put_u16(page,4,0x001e);	// ONFI 1.0 to 2.2
+	memcpy(page+32,"MICRON      ",12);
+	memcpy(page+44,"MT29F64G08CBABAWP   ",20);
+	page[64] = 0x2c;
+	simulator_put_u32(page,80,simulator.page_size);
+	simulator_put_u16(page,84,simulator.spare_size);
+	simulator_put_u32(page,92,simulator.pages_per_block);
+	simulator_put_u32(page,96,simulator.blocks_per_lun);
+	page[100] = simulator.num_luns;
+	page[101] = 0x23;
+	page[102] = 2;
+	page[113] = simulator_bits_for(simulator.num_planes);
+	simulator_put_u16(page,129,0x003f);
+	simulator_put_u16(page,133,simulator.t_prog_us);
+	simulator_put_u16(page,135,simulator.t_bers_us);
+	simulator_put_u16(page,137,simulator.t_r_us);
+	simulator_put_u16(page,139,200);
+	simulator_put_u16(page,254,onfi_crc16(page,254));
+
+	for(uint8_t copy=0;copy<3;copy++)
+	{
+		memcpy(simulator_buffer+256*copy,page,256);
+	}
+	simulator_buffer_len = 768;
+	simulator_buffer_position = 0;
+	simulator_output = SIMULATOR_OUTPUT_BUFFER;
+}
+
+// loads a page of the array in to the data register of its plane
+void simulator_load_page(uint32_t page_number)
+{
+	simulator_lun* lun = &simulator_luns[simulator_lun_of(page_number)];
+	uint8_t plane = simulator_plane_of(page_number);
+
+	simulator_array_read(page_number,lun->planes[plane].data);
+	lun->data_page = page_number;
+	lun->read_plane = plane;
+	simulator_stats.page_reads++;
+}
+
+// starts the program of the cache register of a plane
+// .. cache programs wait for the array to finish the previous page
+void simulator_program(simulator_lun* lun, uint8_t plane, uint32_t page_number, uint64_t start)
+{
+	bool failed = simulator_block_failing(page_number) || !(simulator_last_port&WP_mask);
+
+	if(!failed)
+	{
+		simulator_array_program(page_number,lun->planes[plane].cache);
+	}
+	lun->fail = lun->fail||failed;
+	(void)start;
+}
+
+void simulator_confirm_program(uint8_t command)
+{
+	if(simulator_program_page==SIMULATOR_NO_PAGE)
+	{
+		printf("Simulator: program confirm without 0x80\n");
+		return;
+	}
+	simulator_lun* lun = &simulator_luns[simulator_lun_of(simulator_program_page)];
+	uint8_t plane = simulator_plane_of(simulator_program_page);
+
+	if(command==0x11)
+	{
+		lun->planes[plane].queued = true;
+		lun->planes[plane].queued_page = simulator_program_page;
+		lun->ready_at = simulator_time+1000ull*simulator.t_cbsy_us/4;
+		return;
+	}
+
+	// the data register takes the page once the array is done with the one before
+	uint64_t start = (simulator_time>lun->array_ready_at)?simulator_time:lun->array_ready_at;
+	lun->fail_previous = lun->fail;
+	lun->fail = false;
+	for(uint8_t p=0;p<simulator.num_planes;p++)
+	{
+		if(lun->planes[p].queued && p!=plane)
+		{
+			simulator_program(lun,p,lun->planes[p].queued_page,start);
+		}
+		lun->planes[p].queued = false;
+	}
+	simulator_program(lun,plane,simulator_program_page,start);
+
+	lun->array_ready_at = start+1000ull*simulator.t_prog_us;
+	if(command==0x15)
+	{
+		lun->ready_at = start+1000ull*simulator.t_cbsy_us;
+	}else
+	{
+		lun->ready_at = lun->array_ready_at;
+	}
+	simulator_program_page = SIMULATOR_NO_PAGE;
+}
+
+void simulator_confirm_erase()
+{
+	if(simulator_num_erase==0)
+	{
+		return;
+	}
+	simulator_lun* lun = &simulator_luns[simulator_lun_of(simulator_erase_blocks[0]*simulator.pages_per_block)];
+
+	lun->fail_previous = false;
+	lun->fail = false;
+	for(uint8_t i=0;i<simulator_num_erase;i++)
+	{
+		if(simulator_block_failing(simulator_erase_blocks[i]*simulator.pages_per_block) || !(simulator_last_port&WP_mask))
+		{
+			lun->fail = true;
+		}else
+		{
+			simulator_array_erase(simulator_erase_blocks[i]);
+		}
+	}
+	lun->array_ready_at = simulator_time+1000ull*simulator.t_bers_us;
+	lun->ready_at = lun->array_ready_at;
+	simulator_num_erase = 0;
+}
+
+// the cache register of the read plane gets the data register, the next page (if any) goes to the data register
+void simulator_cache_read(uint32_t next_page)
+{
+	simulator_lun* lun = &simulator_luns[simulator_lun_selected];
+	uint8_t plane = lun->read_plane;
+
+	uint64_t start = (simulator_time>lun->array_ready_at)?simulator_time:lun->array_ready_at;
+	memcpy(lun->planes[plane].cache,lun->planes[plane].data,simulator_page_length());
+	lun->plane = plane;
+	simulator_column = 0;
+	simulator_output = SIMULATOR_OUTPUT_CACHE;
+	lun->ready_at = start+1000ull*simulator.t_cbsy_us;
+	if(next_page!=SIMULATOR_NO_PAGE)
+	{
+		simulator_load_page(next_page);
+		lun->array_ready_at = start+1000ull*simulator.t_r_us;
+	}else
+	{
+		lun->array_ready_at = lun->ready_at;
+	}
+	simulator_stats.cache_reads++;
+}
+
+uint32_t simulator_column_of(uint8_t* address)
+{
+	return address[0]|((uint32_t)address[1]<<8);
+}
+
+// address cycles are taken once the next cycle shows how many there were
+void simulator_finish_address()
+{
+	if(simulator_num_address==0)
+	{
+		return;
+	}
+	uint8_t num = simulator_num_address;
+	simulator_num_address = 0;
+
+	switch(simulator_command)
+	{
+		case 0x00:
+			simulator_read_column = simulator_column_of(simulator_address);
+			if(num>=5)
+			{
+				simulator_read_page = simulator_row_to_page(simulator_address+2);
+			}
+			break;
+		case 0x80:
+		case 0x85:
+			simulator_column = simulator_column_of(simulator_address);
+			if(num>=5)
+			{
+				simulator_program_page = simulator_row_to_page(simulator_address+2);
+				simulator_lun_selected = simulator_lun_of(simulator_program_page);
+				simulator_luns[simulator_lun_selected].plane = simulator_plane_of(simulator_program_page);
+			}
+			if(simulator_command==0x80)
+			{
+				simulator_lun* lun = &simulator_luns[simulator_lun_selected];
+				memset(lun->planes[lun->plane].cache,0xff,simulator_page_length());
+			}
+			break;
+		case 0x05:
+			simulator_read_column = simulator_column_of(simulator_address);
+			break;
+		case 0x06:
+			simulator_read_column = simulator_column_of(simulator_address);
+			simulator_read_page = simulator_row_to_page(simulator_address+2);
+			break;
+	}
+}
+
+// address cycles of commands that act as soon as they have all of them
+void simulator_address_cycle(uint8_t value)
+{
+	if(simulator_num_address<sizeof(simulator_address))
+	{
+		simulator_address[simulator_num_address++] = value;
+	}
+	uint8_t num = simulator_num_address;
+
+	switch(simulator_command)
+	{
+		case 0x90:
+		{
+			const uint8_t id[8] = {0x2c,0x64,0x44,0x4b,0xa9,0x00,0x00,0x00};
+			if(value==0x20)
+			{
+				simulator_set_buffer((const uint8_t*)"ONFI",4);
+			}else if(value==0x40)
+			{
+				simulator_set_buffer((const uint8_t*)"JEDEC",5);
+			}else
+			{
+				simulator_set_buffer(id,8);
+			}
+			simulator_num_address = 0;
+			break;
+		}
+		case 0xec:
+			simulator_parameter_page();
+			simulator_luns[0].ready_at = simulator_time+1000ull*simulator.t_r_us/4;
+			simulator_num_address = 0;
+			break;
+		case 0xed:
+		{
+			uint8_t unique[32];
+			for(uint8_t i=0;i<16;i++)
+			{
+				unique[i] = 0x10+i;
+				unique[16+i] = ~unique[i];
+			}
+			for(uint8_t copy=0;copy<16;copy++)
+			{
+				memcpy(simulator_buffer+32*copy,unique,32);
+			}
+			simulator_buffer_len = 512;
+			simulator_buffer_position = 0;
+			simulator_output = SIMULATOR_OUTPUT_BUFFER;
+			simulator_luns[0].ready_at = simulator_time+1000ull*simulator.t_r_us/4;
+			simulator_num_address = 0;
+			break;
+		}
+		case 0xee:
+			simulator_set_buffer(simulator_features[value],4);
+			simulator_luns[0].ready_at = simulator_time+1000;
+			simulator_num_address = 0;
+			break;
+		case 0xef:
+			simulator_feature_address = value;
+			simulator_feature_count = 0;
+			simulator_num_address = 0;
+			break;
+		case 0x78:
+			if(num==3)
+			{
+				simulator_lun_selected = simulator_lun_of(simulator_row_to_page(simulator_address));
+				simulator_output = SIMULATOR_OUTPUT_STATUS;
+				simulator_num_address = 0;
+			}
+			break;
+		case 0xfa:
+			if(num==3)
+			{
+				simulator_lun* lun = &simulator_luns[simulator_lun_of(simulator_row_to_page(simulator_address))];
+				lun->ready_at = simulator_time+1000ull*simulator.t_rst_us;
+				lun->array_ready_at = lun->ready_at;
+				simulator_num_address = 0;
+			}
+			break;
+		case 0x60:
+			if(num==3)
+			{
+				if(simulator_num_erase<SIMULATOR_MAX_PLANES)
+				{
+					simulator_erase_blocks[simulator_num_erase++] = simulator_row_to_page(simulator_address)/simulator.pages_per_block;
+				}
+				simulator_lun_selected = simulator_lun_of(simulator_row_to_page(simulator_address));
+				simulator_num_address = 0;
+			}
+			break;
+	}
+}
+
+void simulator_command_cycle(uint8_t command)
+{
+	simulator_finish_address();
+	simulator_stats.commands++;
+	simulator_previous_command = simulator_command;
+	simulator_command = command;
+
+	switch(command)
+	{
+		case 0x00:
+			// also ends a status read, data out goes back to the cache register
+			simulator_output = SIMULATOR_OUTPUT_CACHE;
+			break;
+		case 0x30:
+		case 0x32:
+		{
+			uint32_t page_number = simulator_read_page;
+			simulator_lun* lun = &simulator_luns[simulator_lun_of(page_number)];
+			uint8_t plane = simulator_plane_of(page_number);
+
+			simulator_lun_selected = simulator_lun_of(page_number);
+			simulator_load_page(page_number);
+			memcpy(lun->planes[plane].cache,lun->planes[plane].data,simulator_page_length());
+			lun->plane = plane;
+			simulator_column = simulator_read_column;
+			simulator_output = SIMULATOR_OUTPUT_CACHE;
+			if(command==0x30)
+			{
+				lun->array_ready_at = simulator_time+1000ull*simulator.t_r_us;
+			}else
+			{
+				lun->array_ready_at = simulator_time+1000ull*simulator.t_cbsy_us/4;
+			}
+			lun->ready_at = lun->array_ready_at;
+			break;
+		}
+		case 0x31:
+		{
+			simulator_lun* lun = &simulator_luns[simulator_lun_selected];
+			uint32_t next_page = lun->data_page+1;
+			// 0x00 with an address before it is a random cache read
+			if(simulator_previous_command==0x00 && simulator_read_page!=SIMULATOR_NO_PAGE)
+			{
+				next_page = simulator_read_page;
+			}
+			simulator_read_page = SIMULATOR_NO_PAGE;
+			simulator_cache_read(next_page);
+			break;
+		}
+		case 0x3f:
+			simulator_cache_read(SIMULATOR_NO_PAGE);
+			break;
+		case 0x80:
+			simulator_program_page = SIMULATOR_NO_PAGE;
+			break;
+		case 0x10:
+		case 0x11:
+		case 0x15:
+			simulator_confirm_program(command);
+			break;
+		case 0x60:
+			if(simulator_previous_command!=0x60)
+			{
+				simulator_num_erase = 0;
+			}
+			break;
+		case 0xd0:
+			simulator_confirm_erase();
+			break;
+		case 0xe0:
+			if(simulator_previous_command==0x06 && simulator_read_page!=SIMULATOR_NO_PAGE)
+			{
+				simulator_lun_selected = simulator_lun_of(simulator_read_page);
+				simulator_luns[simulator_lun_selected].plane = simulator_plane_of(simulator_read_page);
+			}
+			simulator_column = simulator_read_column;
+			simulator_read_page = SIMULATOR_NO_PAGE;
+			simulator_output = SIMULATOR_OUTPUT_CACHE;
+			break;
+		case 0x70:
+			simulator_output = SIMULATOR_OUTPUT_STATUS;
+			break;
+		case 0xff:
+			for(uint8_t i=0;i<simulator.num_luns;i++)
+			{
+				simulator_luns[i].ready_at = simulator_time+1000ull*simulator.t_rst_us;
+				simulator_luns[i].array_ready_at = simulator_luns[i].ready_at;
+				simulator_luns[i].fail = false;
+				simulator_luns[i].fail_previous = false;
+			}
+			memset(simulator_features,0,sizeof(simulator_features));
+			simulator_output = SIMULATOR_OUTPUT_NONE;
+			simulator_read_page = SIMULATOR_NO_PAGE;
+			simulator_program_page = SIMULATOR_NO_PAGE;
+			break;
+	}
+}
+
+void simulator_data_in(uint8_t value)
+{
+	simulator_finish_address();
+	simulator_stats.bytes_in++;
+
+	if(simulator_command==0xef)
+	{
+		if(simulator_feature_count<4)
+		{
+			simulator_features[simulator_feature_address][simulator_feature_count++] = value;
+		}
+		if(simulator_feature_count==4)
+		{
+			simulator_luns[0].ready_at = simulator_time+1000;
+		}
+		return;
+	}
+	simulator_lun* lun = &simulator_luns[simulator_lun_selected];
+	if(simulator_column<simulator_page_length())
+	{
+		lun->planes[lun->plane].cache[simulator_column] = value;
+	}
+	simulator_column++;
+}
+
+uint8_t simulator_data_out()
+{
+	simulator_finish_address();
+	simulator_stats.bytes_out++;
+
+	simulator_lun* lun = &simulator_luns[simulator_lun_selected];
+	switch(simulator_output)
+	{
+		case SIMULATOR_OUTPUT_STATUS:
+			if(simulator_time<lun->ready_at || simulator_time<lun->array_ready_at)
+			{
+				simulator_time += SIMULATOR_BUSY_POLL_NS;
+			}
+			return simulator_status(lun);
+		case SIMULATOR_OUTPUT_CACHE:
+		{
+			uint8_t value = 0xff;
+			if(simulator_column<simulator_page_length())
+			{
+				value = lun->planes[lun->plane].cache[simulator_column];
+			}
+			simulator_column++;
+			return value;
+		}
+		case SIMULATOR_OUTPUT_BUFFER:
+		{
+			if(simulator_buffer_len==0)
+			{
+				return 0xff;
+			}
+			uint8_t value = simulator_buffer[simulator_buffer_position];
+			simulator_buffer_position = (simulator_buffer_position+1)%simulator_buffer_len;
+			return value;
+		}
+	}
+	return 0xff;
+}
+
+void host_port_write(uint32_t value)
+{
+	uint32_t previous = simulator_last_port;
+	simulator_time += SIMULATOR_PORT_ACCESS_NS;
+	simulator_last_port = value;
+
+	if(value&CE_mask)
+	{
+		return;
+	}
+	// WE# rising edge latches a command, an address or a data byte
+	if(!(previous&WE_mask) && (value&WE_mask))
+	{
+		uint8_t dq = (value&DQ_mask)>>DQ_shift;
+		if(value&CLE_mask)
+		{
+			simulator_command_cycle(dq);
+		}else if(value&ALE_mask)
+		{
+			simulator_address_cycle(dq);
+		}else
+		{
+			simulator_data_in(dq);
+		}
+	}
+	// RE# falling edge puts the next byte out
+	if((previous&RE_mask) && !(value&RE_mask))
+	{
+		simulator_dq = simulator_data_out();
+	}
+}
+
+uint32_t host_port_read()
+{
+	simulator_time += SIMULATOR_PORT_ACCESS_NS;
+	// a look at a busy R/B# moves the clock on, so polling loops stay short on the host
+	if(!simulator_ready())
+	{
+		simulator_time += SIMULATOR_BUSY_POLL_NS;
+	}
+	return (simulator_last_port&~(DQ_mask|RB_mask))|((uint32_t)simulator_dq<<DQ_shift)|(simulator_ready()?RB_mask:0);
+}
+
+void host_port_direction_write(uint32_t value)
+{
+	(void)value;
+	simulator_time += SIMULATOR_PORT_ACCESS_NS;
+}
+
+void host_delay_cycles(uint16_t cycles)
+{
+	simulator_time += ((uint64_t)cycles*1000+CPU_CLOCK_MHZ-1)/CPU_CLOCK_MHZ;
+}
+
+void host_timer_start()
+{
+	simulator_timer_start = simulator_time;
+}
+
+// the timer counts down from 0xffffffff at CPU_CLOCK_MHZ
+void host_timer_snapshot()
+{
+	uint32_t counter = 0xffffffff-(uint32_t)((simulator_time-simulator_timer_start)*CPU_CLOCK_MHZ/1000);
+	host_timer_registers[4] = counter&0xffff;
+	host_timer_registers[5] = counter>>16;
+}
+
+bool nand_simulator_open(const nand_simulator_config* config)
+{
+	nand_simulator_close();
+	simulator = *config;
+	if(simulator.num_luns>SIMULATOR_MAX_LUNS || simulator.num_planes>SIMULATOR_MAX_PLANES)
+	{
+		printf("Simulator: too many LUNs or planes\n");
+		return false;
+	}
+	simulator_page_bits = simulator_bits_for(simulator.pages_per_block);
+	simulator_block_bits = simulator_bits_for(simulator.blocks_per_lun);
+	simulator_array_size = (uint64_t)simulator.num_luns*simulator_pages_per_lun()*simulator_page_length();
+
+	if(simulator.backing_file!=NULL)
+	{
+		simulator_file = open(simulator.backing_file,O_RDWR|O_CREAT,0644);
+		if(simulator_file<0 || ftruncate(simulator_file,simulator_array_size)!=0)
+		{
+			printf("Simulator: cannot open %s\n",simulator.backing_file);
+			return false;
+		}
+		simulator_array = (uint8_t*)mmap(NULL,simulator_array_size,PROT_READ|PROT_WRITE,MAP_SHARED,simulator_file,0);
+	}else
+	{
+		simulator_array = (uint8_t*)mmap(NULL,simulator_array_size,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE,-1,0);
+	}
+	if(simulator_array==MAP_FAILED)
+	{
+		simulator_array = NULL;
+		printf("Simulator: cannot map %llu bytes\n",(unsigned long long)simulator_array_size);
+		return false;
+	}
+
+	uint32_t num_blocks = simulator.num_luns*simulator.blocks_per_lun;
+	simulator_failing = (uint8_t*)calloc((num_blocks+7)/8,1);
+	memset(simulator_luns,0,sizeof(simulator_luns));
+	for(uint8_t l=0;l<simulator.num_luns;l++)
+	{
+		for(uint8_t p=0;p<simulator.num_planes;p++)
+		{
+			simulator_luns[l].planes[p].cache = (uint8_t*)malloc(simulator_page_length());
+			simulator_luns[l].planes[p].data = (uint8_t*)malloc(simulator_page_length());
+			memset(simulator_luns[l].planes[p].cache,0xff,simulator_page_length());
+			memset(simulator_luns[l].planes[p].data,0xff,simulator_page_length());
+		}
+		simulator_luns[l].data_page = SIMULATOR_NO_PAGE;
+	}
+	memset(&simulator_stats,0,sizeof(simulator_stats));
+	memset(simulator_features,0,sizeof(simulator_features));
+	simulator_time = 0;
+	simulator_timer_start = 0;
+	simulator_last_port = CE_mask|RE_mask|WE_mask;
+	simulator_output = SIMULATOR_OUTPUT_NONE;
+	simulator_num_address = 0;
+	simulator_read_page = SIMULATOR_NO_PAGE;
+	simulator_program_page = SIMULATOR_NO_PAGE;
+	return true;
+}
+
+void nand_simulator_close()
+{
+	if(simulator_array!=NULL)
+	{
+		munmap(simulator_array,simulator_array_size);
+		simulator_array = NULL;
+	}
+	if(simulator_file>=0)
+	{
+		close(simulator_file);
+		simulator_file = -1;
+	}
+	for(uint8_t l=0;l<SIMULATOR_MAX_LUNS;l++)
+	{
+		for(uint8_t p=0;p<SIMULATOR_MAX_PLANES;p++)
+		{
+			free(simulator_luns[l].planes[p].cache);
+			free(simulator_luns[l].planes[p].data);
+			simulator_luns[l].planes[p].cache = NULL;
+			simulator_luns[l].planes[p].data = NULL;
+		}
+	}
+	free(simulator_failing);
+	simulator_failing = NULL;
+}
+
+uint64_t nand_simulator_time_ns()
+{
+	return simulator_time;
+}
+
+void nand_simulator_advance(uint32_t ns)
+{
+	simulator_time += ns;
+}
+
+void nand_simulator_fail_block(uint32_t block, bool fail)
+{
+	if(fail)
+	{
+		simulator_failing[block>>3] |= 1<<(block&7);
+	}else
+	{
+		simulator_failing[block>>3] &= ~(1<<(block&7));
+	}
+}
+
+void nand_simulator_mark_factory_bad(uint32_t block)
+{
+	// inverted 0x00
+	simulator_page_bytes(block*simulator.pages_per_block)[simulator.page_size] = 0xff;
+}
+
+void nand_simulator_flip_bits(uint32_t page_number, uint16_t num_bits)
+{
+	uint8_t* bytes = simulator_page_bytes(page_number);
+	for(uint16_t i=0;i<num_bits;i++)
+	{
+		uint32_t bit = rand()%(simulator_page_length()*8);
+		bytes[bit/8] ^= 0x80>>(bit%8);
+	}
+}
+
+#endif
@@ -0,0 +1,85 @@
+/*
+File: nand_simulator.h
+Description: Host model of the NAND device behind the parallel port
+			.. only built with HOST_SIMULATION, it is the host backend of the port functions:
+			.. .. host_port_write/read/direction_write, host_delay_cycles and the timer
+			.. the pin changes are decoded in to ONFI cycles: WE# rising edges latch commands, addresses
+			.. .. and data in, RE# falling edges put the next byte of data out on DQ
+			.. each LUN has a page (data) register and a cache register per plane, a status register
+			.. .. and RDY/ARDY times on a virtual clock that moves with every port access and delay
+			.. .. the timer of the driver counts CPU_CLOCK_MHZ cycles of that clock
+			.. the geometry and array times of the configuration are given out in the parameter page
+			.. the array is a memory mapped file (or anonymous memory) holding the inverted bytes
+			.. .. so an all-zero (sparse) file is an erased device and an erase punches a hole
+			.. Each of the functions declared here are defined in file nand_simulator.c
+*/
+#ifndef nand_simulator_h
+#define nand_simulator_h
+
+#include "nand_interface_header.h"
+
+#define SIMULATOR_MAX_LUNS 4
+#define SIMULATOR_MAX_PLANES 2
+
+// virtual time of one access to the parallel port
+#define SIMULATOR_PORT_ACCESS_NS 10
+// extra time of a look at R/B# or at the status while busy
+#define SIMULATOR_BUSY_POLL_NS 1000
+
+typedef struct
+{
+	uint16_t page_size;
+	uint16_t spare_size;
+	uint32_t pages_per_block;
+	uint32_t blocks_per_lun;
+	uint8_t num_luns;
+	uint8_t num_planes;
+	uint16_t t_r_us;
+	uint16_t t_prog_us;
+	uint16_t t_bers_us;
+	uint16_t t_rst_us;
+	uint16_t t_cbsy_us;		// cache busy of cache read/program and tDBSY of multi-plane
+	// backing file, NULL keeps the array in anonymous memory
+	const char* backing_file;
+}nand_simulator_config;
+
+// MT29F64G08CBABA
+extern const nand_simulator_config simulator_default_config;
+
+// function to start the model, has to be called before device_initialization()
+// .. a backing file that already exists keeps its contents
+bool nand_simulator_open(const nand_simulator_config* config);
+
+void nand_simulator_close();
+
+// virtual time in ns since nand_simulator_open()
+uint64_t nand_simulator_time_ns();
+
+// moves the virtual clock, used by the delays of the driver
+void nand_simulator_advance(uint32_t ns);
+
+// block number here is lun*blocks_per_lun+block
+// .. programs and erases of the block report FAIL
+void nand_simulator_fail_block(uint32_t block, bool fail);
+
+// .. puts a factory bad block marker (0x00 in the first spare byte of the first page)
+void nand_simulator_mark_factory_bad(uint32_t block);
+
+// .. flips num_bits random bits of a page (page number lun*pages_per_lun+block*pages_per_block+page)
+void nand_simulator_flip_bits(uint32_t page_number, uint16_t num_bits);
+
+// number of operations the model has run
+typedef struct
+{
+	uint32_t page_reads;
+	uint32_t cache_reads;
+	uint32_t page_programs;
+	uint32_t block_erases;
+	uint32_t commands;
+	uint64_t bytes_in;
+	uint64_t bytes_out;
+}nand_simulator_statistics;
+
+extern nand_simulator_statistics simulator_stats;
+
+#endif
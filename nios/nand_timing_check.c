@@ -0,0 +1,457 @@
+#include "nand_timing_check.h"
+#include "nand_trace.h"
+
+#if TIMING_CHECK
+
+#define TIMING_NEVER 0xffffffff
+
+// what the last WE# rising edge latched
+#define TIMING_LATCH_NONE 0
+#define TIMING_LATCH_COMMAND 1
+#define TIMING_LATCH_ADDRESS 2
+#define TIMING_LATCH_DATA 3
+
+timing_rule_result timing_check_results[TIMING_RULES];
+
+const char* timing_rule_names[TIMING_RULES] =
+{
+	"tWP","tWH","tWC","tDS","tDH","tCS","tCH","tCLS","tCLH","tALS","tALH",
+	"tRP","tREH","tRC","tREA","tWB","tWHR","tRR","tADL","tCCS","tRHW"
+};
+
+timing_check_event timing_check_events[TIMING_CHECK_EVENTS];
+uint32_t timing_check_count = 0;
+const char* timing_check_marks[TIMING_CHECK_MARKS];
+uint8_t timing_check_num_marks = 0;
+
+// timer at timing_check_start()
+uint32_t timing_check_origin = 0;
+// cycles of one timing_capture()
+uint32_t timing_check_cost = 0;
+// cycles spent checking while capturing
+uint32_t timing_check_pause = 0;
+// events captured since timing_check_start()
+uint32_t timing_check_total = 0;
+
+// state of the replay, carried from one buffer to the next
+struct
+{
+	uint32_t pins;
+	uint32_t direction;
+	uint32_t event;				// number of the event being checked
+	const char* label;
+	uint8_t command;
+	uint8_t latch;
+	uint8_t num_address;		// address cycles since the command
+	uint8_t num_data;			// data input cycles since the address
+	bool hold_pending;			// WE# went high, the holds are checked until it goes low again
+	bool busy;					// a busy time was started, waiting for R/B# high
+	// times of the last edges, TIMING_NEVER before the first one
+	uint32_t we_fall;
+	uint32_t we_rise;
+	uint32_t re_fall;
+	uint32_t re_rise;
+	uint32_t ce_fall;
+	uint32_t cle_rise;
+	uint32_t ale_rise;
+	uint32_t dq_set;
+	uint32_t address;			// last address cycle
+	// starts of the waits that end on a later edge, TIMING_NEVER if none is open
+	uint32_t wb_from;
+	uint32_t whr_from;
+	uint32_t ccs_from;
+	uint32_t rr_from;
+}timing_replay;
+
+uint32_t timing_printed = 0;
+
+void timing_check_rule(uint8_t rule, uint32_t from, uint32_t now)
+{
+	if(from==TIMING_NEVER)
+	{
+		return;
+	}
+
+	timing_rule_result* result = &timing_check_results[rule];
+	uint32_t ns = (uint64_t)(now-from)*1000/CPU_CLOCK_MHZ;
+	if(ns>=result->min_ns)
+	{
+		return;
+	}
+	if(!result->violations || ns<result->worst_ns)
+	{
+		result->worst_ns = ns;
+	}
+	result->violations++;
+	if(timing_printed<TIMING_CHECK_PRINT_LIMIT)
+	{
+		timing_printed++;
+		printf("%s: %lu ns < %lu ns at event %lu (%s, command 0x%02x)\n",timing_rule_names[rule],ns,result->min_ns,
+			timing_replay.event,timing_replay.label?timing_replay.label:"-",timing_replay.command);
+	}
+}
+
+// commands after which the LUN goes busy
+bool timing_command_busy(uint8_t command)
+{
+	switch(command)
+	{
+		case 0x10:
+		case 0x11:
+		case 0x15:
+		case 0x30:
+		case 0x31:
+		case 0x32:
+		case 0x35:
+		case 0x3f:
+		case 0xd0:
+		case 0xd1:
+		case 0xff:
+			return true;
+	}
+	return false;
+}
+
+void timing_start_busy(uint32_t time)
+{
+	timing_replay.wb_from = time;
+	timing_replay.busy = true;
+}
+
+// a WE# rising edge with CE# low
+void timing_latch(uint32_t value, uint32_t time)
+{
+	uint8_t byte = (value&DQ_mask)>>DQ_shift;
+
+	timing_check_rule(TIMING_RULE_tWP,timing_replay.we_fall,time);
+	timing_check_rule(TIMING_RULE_tDS,timing_replay.dq_set,time);
+	timing_check_rule(TIMING_RULE_tCS,timing_replay.ce_fall,time);
+
+	if(value&CLE_mask)
+	{
+		timing_check_rule(TIMING_RULE_tCLS,timing_replay.cle_rise,time);
+		timing_replay.command = byte;
+		timing_replay.latch = TIMING_LATCH_COMMAND;
+		timing_replay.num_address = 0;
+		timing_replay.whr_from = TIMING_NEVER;
+		timing_replay.ccs_from = TIMING_NEVER;
+		timing_replay.rr_from = TIMING_NEVER;
+		if(timing_command_busy(byte))
+		{
+			timing_start_busy(time);
+		}else if(byte==0x70)
+		{
+			timing_replay.whr_from = time;
+		}else if(byte==0xe0)
+		{
+			timing_replay.ccs_from = time;
+		}
+	}else if(value&ALE_mask)
+	{
+		timing_check_rule(TIMING_RULE_tALS,timing_replay.ale_rise,time);
+		timing_replay.latch = TIMING_LATCH_ADDRESS;
+		timing_replay.address = time;
+		timing_replay.num_address++;
+		timing_replay.num_data = 0;
+		switch(timing_replay.command)
+		{
+			case 0x78:
+			case 0x90:
+				timing_replay.whr_from = time;
+				break;
+			case 0xec:
+			case 0xed:
+			case 0xee:
+				timing_start_busy(time);
+				break;
+			case 0xfa:
+				if(timing_replay.num_address==device_geometry.row_address_cycles)
+				{
+					timing_start_busy(time);
+				}
+				break;
+		}
+	}else
+	{
+		// first data input after the address cycles
+		if(timing_replay.latch==TIMING_LATCH_ADDRESS)
+		{
+			timing_check_rule((timing_replay.command==0x85)?TIMING_RULE_tCCS:TIMING_RULE_tADL,timing_replay.address,time);
+		}
+		timing_replay.latch = TIMING_LATCH_DATA;
+		timing_replay.num_data++;
+		// set features goes busy after its 4 parameters
+		if(timing_replay.command==0xef && timing_replay.num_data==4)
+		{
+			timing_start_busy(time);
+		}
+	}
+	timing_replay.we_rise = time;
+	timing_replay.hold_pending = true;
+}
+
+void timing_replay_store(uint32_t value, uint32_t time)
+{
+	uint32_t previous = timing_replay.pins;
+	uint32_t changed = previous^value;
+	bool selected = !(value&CE_mask);
+
+	// holds after the last latch
+	if(timing_replay.hold_pending)
+	{
+		if(changed&DQ_mask)
+		{
+			timing_check_rule(TIMING_RULE_tDH,timing_replay.we_rise,time);
+		}
+		if((changed&CLE_mask) && !(value&CLE_mask))
+		{
+			timing_check_rule(TIMING_RULE_tCLH,timing_replay.we_rise,time);
+		}
+		if((changed&ALE_mask) && !(value&ALE_mask))
+		{
+			timing_check_rule(TIMING_RULE_tALH,timing_replay.we_rise,time);
+		}
+		if((changed&CE_mask) && (value&CE_mask))
+		{
+			timing_check_rule(TIMING_RULE_tCH,timing_replay.we_rise,time);
+		}
+	}
+
+	if((changed&CE_mask) && selected)
+	{
+		timing_replay.ce_fall = time;
+	}
+	if((changed&CLE_mask) && (value&CLE_mask))
+	{
+		timing_replay.cle_rise = time;
+	}
+	if((changed&ALE_mask) && (value&ALE_mask))
+	{
+		timing_replay.ale_rise = time;
+	}
+	if(changed&DQ_mask)
+	{
+		timing_replay.dq_set = time;
+	}
+	timing_replay.pins = value;
+
+	if(!selected)
+	{
+		return;
+	}
+
+	// WE# falling edge: the start of a latch cycle
+	if((changed&WE_mask) && !(value&WE_mask))
+	{
+		timing_check_rule(TIMING_RULE_tWH,timing_replay.we_rise,time);
+		timing_check_rule(TIMING_RULE_tWC,timing_replay.we_fall,time);
+		// the last cycle was a data output
+		if(timing_replay.re_rise!=TIMING_NEVER && (timing_replay.we_rise==TIMING_NEVER || timing_replay.re_rise>timing_replay.we_rise))
+		{
+			timing_check_rule(TIMING_RULE_tRHW,timing_replay.re_rise,time);
+		}
+		// nothing may follow a busy command before tWB
+		timing_check_rule(TIMING_RULE_tWB,timing_replay.wb_from,time);
+		timing_replay.wb_from = TIMING_NEVER;
+		timing_replay.we_fall = time;
+		timing_replay.hold_pending = false;
+	}
+	// WE# rising edge latches
+	if((changed&WE_mask) && (value&WE_mask))
+	{
+		timing_latch(value,time);
+	}
+	// RE# falling edge: the device starts driving DQ
+	if((changed&RE_mask) && !(value&RE_mask))
+	{
+		timing_check_rule(TIMING_RULE_tREH,timing_replay.re_rise,time);
+		timing_check_rule(TIMING_RULE_tRC,timing_replay.re_fall,time);
+		timing_check_rule(TIMING_RULE_tWHR,timing_replay.whr_from,time);
+		timing_check_rule(TIMING_RULE_tCCS,timing_replay.ccs_from,time);
+		timing_check_rule(TIMING_RULE_tRR,timing_replay.rr_from,time);
+		timing_check_rule(TIMING_RULE_tWB,timing_replay.wb_from,time);
+		timing_replay.whr_from = TIMING_NEVER;
+		timing_replay.ccs_from = TIMING_NEVER;
+		timing_replay.rr_from = TIMING_NEVER;
+		timing_replay.wb_from = TIMING_NEVER;
+		timing_replay.re_fall = time;
+	}
+	if((changed&RE_mask) && (value&RE_mask))
+	{
+		timing_check_rule(TIMING_RULE_tRP,timing_replay.re_fall,time);
+		timing_replay.re_rise = time;
+	}
+}
+
+void timing_replay_read(uint32_t value, uint32_t time)
+{
+	// R/B# is not valid before tWB
+	timing_check_rule(TIMING_RULE_tWB,timing_replay.wb_from,time);
+	timing_replay.wb_from = TIMING_NEVER;
+
+	// DQ sampled during a data output cycle
+	if(!(timing_replay.pins&(RE_mask|CE_mask)))
+	{
+		timing_check_rule(TIMING_RULE_tREA,timing_replay.re_fall,time);
+	}
+	if(timing_replay.busy && (value&RB_mask))
+	{
+		timing_replay.busy = false;
+		timing_replay.rr_from = time;
+	}
+}
+
+void timing_replay_direction(uint32_t value, uint32_t time)
+{
+	// DQ let go of after a latch
+	if(timing_replay.hold_pending && (timing_replay.direction&DQ_mask) && !(value&DQ_mask))
+	{
+		timing_check_rule(TIMING_RULE_tDH,timing_replay.we_rise,time);
+	}
+	timing_replay.direction = value;
+}
+
+// function to check the captured events and empty the buffer
+void timing_check_replay()
+{
+	for(uint32_t i=0;i<timing_check_count;i++)
+	{
+		timing_check_event* event = &timing_check_events[i];
+		switch(event->kind)
+		{
+			case TIMING_EVENT_STORE:
+				timing_replay_store(event->value,event->time);
+				break;
+			case TIMING_EVENT_READ:
+				timing_replay_read(event->value,event->time);
+				break;
+			case TIMING_EVENT_DIRECTION:
+				timing_replay_direction(event->value,event->time);
+				break;
+			case TIMING_EVENT_MARK:
+				timing_replay.label = timing_check_marks[event->value];
+				break;
+		}
+		timing_replay.event++;
+	}
+	timing_check_count = 0;
+	timing_check_num_marks = 0;
+}
+
+// checks the buffer while capturing, the time it takes does not count
+void timing_check_make_room()
+{
+	uint32_t start = trace_now();
+	timing_check_replay();
+	timing_check_pause += start-trace_now();
+}
+
+void timing_capture(uint8_t kind, uint32_t value)
+{
+	uint32_t now = trace_now();
+
+	if(timing_check_count==TIMING_CHECK_EVENTS)
+	{
+		timing_check_make_room();
+	}
+	timing_check_event* event = &timing_check_events[timing_check_count++];
+	event->time = (timing_check_origin-now)-timing_check_pause-timing_check_total*timing_check_cost;
+	event->value = value;
+	event->kind = kind;
+	timing_check_total++;
+}
+
+void timing_capture_read(uint32_t value)
+{
+	timing_check_events[timing_check_count-1].value = value;
+}
+
+void timing_check_mark(const char* label)
+{
+	if(timing_check_num_marks==TIMING_CHECK_MARKS || timing_check_count==TIMING_CHECK_EVENTS)
+	{
+		timing_check_make_room();
+	}
+	timing_check_marks[timing_check_num_marks] = label;
+	timing_capture(TIMING_EVENT_MARK,timing_check_num_marks++);
+}
+
+#define TIMING_CALIBRATION_ROUNDS 16
+
+void timing_check_start(uint8_t mode)
+{
+	const uint32_t min_ns[TIMING_RULES] =
+	{
+		ONFI_tWP_ns(mode),ONFI_tWH_ns(mode),ONFI_tWC_ns(mode),ONFI_tDS_ns(mode),ONFI_tDH_ns(mode),
+		ONFI_tCS_ns(mode),ONFI_tCH_ns(mode),ONFI_tCLS_ns(mode),ONFI_tCLH_ns(mode),ONFI_tALS_ns(mode),ONFI_tALH_ns(mode),
+		ONFI_tRP_ns(mode),ONFI_tREH_ns(mode),ONFI_tRC_ns(mode),ONFI_tREA_ns(mode),ONFI_tWB_ns(mode),
+		ONFI_tWHR_ns(mode),ONFI_tRR_ns(mode),ONFI_tADL_ns(mode),
+		device_geometry.t_ccs_ns?device_geometry.t_ccs_ns:ONFI_tCCS_ns,
+		ONFI_tRHW_ns(mode)
+	};
+
+	memset(timing_check_results,0,sizeof(timing_check_results));
+	for(uint8_t rule=0;rule<TIMING_RULES;rule++)
+	{
+		timing_check_results[rule].min_ns = min_ns[rule];
+	}
+
+	timer_start();
+	timing_check_origin = trace_now();
+	timing_check_pause = 0;
+	timing_check_total = 0;
+	timing_check_cost = 0;
+	timing_check_num_marks = 0;
+
+	// captures back to back: what is between two of them is the cost of one
+	timing_check_count = 0;
+	for(uint8_t i=0;i<TIMING_CALIBRATION_ROUNDS;i++)
+	{
+		timing_capture(TIMING_EVENT_MARK,0);
+	}
+	timing_check_cost = (timing_check_events[TIMING_CALIBRATION_ROUNDS-1].time-timing_check_events[0].time)/(TIMING_CALIBRATION_ROUNDS-1);
+	timing_check_count = 0;
+	timing_check_total = 0;
+	timing_check_origin = trace_now();
+
+	memset(&timing_replay,0,sizeof(timing_replay));
+	timing_replay.pins = port_shadow;
+	timing_replay.direction = port_direction_shadow;
+	timing_replay.we_fall = TIMING_NEVER;
+	timing_replay.we_rise = TIMING_NEVER;
+	timing_replay.re_fall = TIMING_NEVER;
+	timing_replay.re_rise = TIMING_NEVER;
+	timing_replay.ce_fall = TIMING_NEVER;
+	timing_replay.cle_rise = TIMING_NEVER;
+	timing_replay.ale_rise = TIMING_NEVER;
+	timing_replay.dq_set = TIMING_NEVER;
+	timing_replay.address = TIMING_NEVER;
+	timing_replay.wb_from = TIMING_NEVER;
+	timing_replay.whr_from = TIMING_NEVER;
+	timing_replay.ccs_from = TIMING_NEVER;
+	timing_replay.rr_from = TIMING_NEVER;
+	timing_printed = 0;
+}
+
+uint32_t timing_check_report()
+{
+	uint32_t total = 0;
+
+	timing_check_replay();
+	printf("# timing check: %lu events, capture cost %lu cc\n",timing_check_total,timing_check_cost);
+	printf("rule,min_ns,violations,worst_ns\n");
+	for(uint8_t rule=0;rule<TIMING_RULES;rule++)
+	{
+		timing_rule_result* result = &timing_check_results[rule];
+		printf("%s,%lu,%lu,",timing_rule_names[rule],result->min_ns,result->violations);
+		if(result->violations)
+		{
+			printf("%lu",result->worst_ns);
+		}
+		printf("\n");
+		total += result->violations;
+	}
+	return total;
+}
+
+#endif
@@ -0,0 +1,90 @@
+/*
+File: nand_timing_check.h
+Description: Checker of the bus waveform against the ONFI asynchronous timings
+			.. with TIMING_CHECK every port store, read and direction write is captured with a timer snapshot
+			.. .. on the board from the hardware timer, on the host from the virtual clock of nand_simulator.c
+			.. .. the cycles a capture takes are measured by timing_check_start() and taken off
+			.. the captures are replayed against the rules of the chosen timing mode whenever the buffer is full
+			.. .. the time spent there is taken off too, so any workload can be checked from start to end
+			.. rules: tWP tWH tWC tDS tDH tCS tCH tCLS tCLH tALS tALH tRP tREH tRC tREA tWB tWHR tRR tADL tCCS tRHW
+			.. .. edges are where a store changes a pin, a DQ sample is the port read while RE# is low
+			.. .. R/B# is only seen when it is read, tRR is counted from the first read that sees it high
+			.. .. (the real edge is at or before it, so a reported tRR can be a false alarm, never a miss)
+			.. each violation is printed with the event number, the latest timing_check_mark() label
+			.. .. and the latest command latched, which tell the operation it came from
+			.. the timer runs from timing_check_start(), it wraps after 42 s at 100 MHz
+			.. Each of the functions declared here are defined in file nand_timing_check.c
+*/
+#ifndef nand_timing_check_h
+#define nand_timing_check_h
+
+#include "nand_interface_header.h"
+
+// events kept before they are checked
+#ifndef TIMING_CHECK_EVENTS
+	#define TIMING_CHECK_EVENTS 4096
+#endif
+
+// labels kept before they are checked
+#define TIMING_CHECK_MARKS 16
+
+// number of violations printed, the others are only counted
+#ifndef TIMING_CHECK_PRINT_LIMIT
+	#define TIMING_CHECK_PRINT_LIMIT 32
+#endif
+
+typedef struct
+{
+	uint32_t time;		// cycles since timing_check_start(), capture cost taken off
+	uint32_t value;		// port value (label number for a mark)
+	uint8_t kind;		// TIMING_EVENT_*
+}timing_check_event;
+
+#define TIMING_RULE_tWP 0
+#define TIMING_RULE_tWH 1
+#define TIMING_RULE_tWC 2
+#define TIMING_RULE_tDS 3
+#define TIMING_RULE_tDH 4
+#define TIMING_RULE_tCS 5
+#define TIMING_RULE_tCH 6
+#define TIMING_RULE_tCLS 7
+#define TIMING_RULE_tCLH 8
+#define TIMING_RULE_tALS 9
+#define TIMING_RULE_tALH 10
+#define TIMING_RULE_tRP 11
+#define TIMING_RULE_tREH 12
+#define TIMING_RULE_tRC 13
+#define TIMING_RULE_tREA 14
+#define TIMING_RULE_tWB 15
+#define TIMING_RULE_tWHR 16
+#define TIMING_RULE_tRR 17
+#define TIMING_RULE_tADL 18
+#define TIMING_RULE_tCCS 19
+#define TIMING_RULE_tRHW 20
+#define TIMING_RULES 21
+
+typedef struct
+{
+	uint32_t min_ns;		// of the timing mode checked
+	uint32_t violations;
+	uint32_t worst_ns;		// shortest time seen below min_ns
+}timing_rule_result;
+
+extern timing_rule_result timing_check_results[TIMING_RULES];
+
+// function to start capturing, checked against timing mode mode (0..5)
+// .. restarts the timer, so the trace events around it are spoiled
+void timing_check_start(uint8_t mode);
+
+// function to name the operation of the events that follow
+// .. label must stay valid until timing_check_report()
+void timing_check_mark(const char* label);
+
+// function to check the events captured so far and empty the buffer, the time it takes does not count
+void timing_check_make_room();
+
+// function to check what is left, print one line per rule (rule,min_ns,violations,worst_ns)
+// .. and return the number of violations
+uint32_t timing_check_report();
+
+#endif
@@ -0,0 +1,83 @@
+#include "nand_trace.h"
+
+trace_event trace_ring[TRACE_EVENTS];
+uint32_t trace_head = 0;
+uint32_t trace_bias = 0;
+uint32_t trace_cost = 0;
+
+#define TRACE_CALIBRATION_ROUNDS 16
+
+void trace_init()
+{
+	uint8_t row_address[MAX_ROW_ADDRESS_CYCLES] = {0};
+
+	timer_start();
+
+	// an operation that takes no time: what is left is the instrumentation
+	trace_bias = 0xffffffff;
+	for(uint8_t i=0;i<TRACE_CALIBRATION_ROUNDS;i++)
+	{
+		trace_begin(NAND_OP_NONE,row_address);
+		trace_end(row_address,0);
+		trace_event* event = &trace_ring[(trace_head-1)&(TRACE_EVENTS-1)];
+		if(event->start-event->end<trace_bias)
+		{
+			trace_bias = event->start-event->end;
+		}
+	}
+
+	// whole pairs, timed from outside
+	uint32_t start = trace_now();
+	for(uint8_t i=0;i<TRACE_CALIBRATION_ROUNDS;i++)
+	{
+		trace_begin(NAND_OP_NONE,row_address);
+		trace_end(row_address,0);
+	}
+	trace_cost = (start-trace_now())/TRACE_CALIBRATION_ROUNDS;
+
+	trace_head = 0;
+}
+
+uint32_t trace_drain(trace_event* events, uint32_t max_events)
+{
+	uint32_t first = (trace_head>TRACE_EVENTS)?trace_head-TRACE_EVENTS:0;
+	uint32_t count = 0;
+
+	for(uint32_t i=first;i<trace_head && count<max_events;i++)
+	{
+		events[count++] = trace_ring[i&(TRACE_EVENTS-1)];
+	}
+	trace_head = 0;
+	return count;
+}
+
+void trace_dump()
+{
+	static const char* op_names[] = {"none","read","program","erase","reset"};
+	uint32_t first = (trace_head>TRACE_EVENTS)?trace_head-TRACE_EVENTS:0;
+
+	printf("# trace: %lu events (%lu lost), bias %lu cc, cost %lu cc per event\n",(unsigned long)(trace_head-first),(unsigned long)first,(unsigned long)trace_bias,(unsigned long)trace_cost);
+	printf("op,lun,block,page,cycles,status\n");
+	for(uint32_t i=first;i<trace_head;i++)
+	{
+		trace_event* event = &trace_ring[i&(TRACE_EVENTS-1)];
+		uint8_t row_address[MAX_ROW_ADDRESS_CYCLES];
+		uint8_t lun;
+		uint32_t block,page;
+
+		for(uint8_t j=0;j<device_geometry.row_address_cycles;j++)
+		{
+			row_address[j] = (event->row>>(8*j))&0xff;
+		}
+		split_row_address(row_address,&lun,&block,&page);
+		if(!event->done)
+		{
+			printf("%s,%d,%lu,%lu,,\n",op_names[event->op<=NAND_OP_RESET?event->op:0],lun,(unsigned long)block,(unsigned long)page);
+			continue;
+		}
+		uint32_t cycles = event->start-event->end;
+		printf("%s,%d,%lu,%lu,%lu,0x%x\n",op_names[event->op<=NAND_OP_RESET?event->op:0],lun,(unsigned long)block,(unsigned long)page,
+			(unsigned long)((cycles>trace_bias)?cycles-trace_bias:0),event->status);
+	}
+	trace_head = 0;
+}
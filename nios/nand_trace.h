@@ -0,0 +1,111 @@
+/*
+File: nand_trace.h
+Description: Trace of the array operations
+			.. with TIMER_PROFILE each read, program, erase and reset puts a fixed-size event in a ring in RAM
+			.. .. the timer is snapshotted when the confirm command goes out and when the operation is finished
+			.. .. an event costs a few loads and stores, nothing is printed while the workload runs
+			.. the timer runs freely (down, 32 bits, wraps after 42 s at 100 MHz), started by trace_init()
+			.. .. timer_start() and the timing_test functions restart it, which spoils the events around them
+			.. trace_init() measures what the instrumentation adds to a measured time (trace_bias)
+			.. .. trace_dump() takes it off, so no hand correction is needed
+			.. Each of the functions declared here are defined in file nand_trace.c
+*/
+#ifndef nand_trace_h
+#define nand_trace_h
+
+#include "nand_interface_header.h"
+#include "nand_histogram.h"
+
+// number of events kept, a power of two, the oldest ones are overwritten
+#ifndef TRACE_EVENTS
+	#define TRACE_EVENTS 1024
+#endif
+
+// number of the latest events trace_end() looks through for the one to finish
+#define TRACE_OPEN_WINDOW 8
+
+typedef struct
+{
+	uint32_t start;		// timer at the confirm command
+	uint32_t end;		// timer once the operation was seen finished
+	uint32_t row;		// row address, first cycle in the low byte
+	uint8_t op;			// NAND_OP_*
+	uint8_t status;		// status register value (STATUS_RDY|STATUS_ARDY for reads)
+	bool done;
+}trace_event;
+
+extern trace_event trace_ring[TRACE_EVENTS];
+// number of events recorded since trace_init(), the next one goes to trace_head%TRACE_EVENTS
+extern uint32_t trace_head;
+// cycles the instrumentation adds to each measured time
+extern uint32_t trace_bias;
+// cycles of a trace_begin() and trace_end() pair
+extern uint32_t trace_cost;
+
+// function trace_now()
+// .. one store to take the snapshot and two loads
+FORCE_INLINE inline uint32_t trace_now()
+{
+	*TIMER_COUNTER_SNAP_LOW = 1;
+#if HOST_SIMULATION
+	host_timer_snapshot();
+#endif
+	return ((*TIMER_COUNTER_SNAP_HIGH)<<16)|((*TIMER_COUNTER_SNAP_LOW)&0xffff);
+}
+
+FORCE_INLINE inline uint32_t trace_pack_row(uint8_t* row_address)
+{
+	uint32_t row = 0;
+	for(uint8_t i=0;i<device_geometry.row_address_cycles;i++)
+	{
+		row |= row_address[i]<<(8*i);
+	}
+	return row;
+}
+
+// function to record the start of an operation on row_address
+FORCE_INLINE inline void trace_begin(uint8_t op, uint8_t* row_address)
+{
+	trace_event* event = &trace_ring[trace_head&(TRACE_EVENTS-1)];
+
+	trace_head++;
+	event->op = op;
+	event->row = trace_pack_row(row_address);
+	event->done = false;
+	event->start = trace_now();
+}
+
+// function to record the end of the latest unfinished operation on row_address
+// .. and add its time, bias taken off, to the latency histograms
+FORCE_INLINE inline void trace_end(uint8_t* row_address, uint8_t status)
+{
+	uint32_t end = trace_now();
+	uint32_t row = trace_pack_row(row_address);
+
+	for(uint32_t i=1;i<=TRACE_OPEN_WINDOW && i<=trace_head;i++)
+	{
+		trace_event* event = &trace_ring[(trace_head-i)&(TRACE_EVENTS-1)];
+		if(!event->done && event->row==row)
+		{
+			event->end = end;
+			event->status = status;
+			event->done = true;
+			uint32_t cycles = event->start-end;
+			histogram_record(event->op,row_address,(cycles>trace_bias)?cycles-trace_bias:0);
+			return;
+		}
+	}
+}
+
+// function to start the timer, measure trace_bias and trace_cost and empty the ring
+void trace_init();
+
+// function to copy out up to max_events of the recorded events, oldest first, and empty the ring
+// .. returns the number copied
+uint32_t trace_drain(trace_event* events, uint32_t max_events);
+
+// function to print the recorded events, oldest first, as CSV and empty the ring
+// .. op, lun, block, page, cycles (bias taken off), status
+void trace_dump();
+
+#endif
@@ -0,0 +1,111 @@
+#include "nand_wear_level.h"
+
+uint16_t* wl_erase_count = NULL;
+uint32_t wl_num_blocks = 0;
+uint16_t wl_max_count = 0;
+
+// min-heap of free blocks on their erase count, wl_heap[0] is the least worn
+uint32_t* wl_heap = NULL;
+uint32_t wl_heap_size = 0;
+
+uint32_t wl_count_pages()
+{
+	return (wl_num_blocks*sizeof(uint16_t)+device_geometry.page_size-1)/device_geometry.page_size;
+}
+
+bool wl_init(uint32_t num_blocks)
+{
+	wl_num_blocks = num_blocks;
+	free(wl_erase_count);
+	free(wl_heap);
+	wl_erase_count = (uint16_t*)calloc(wl_count_pages(),device_geometry.page_size);
+	wl_heap = (uint32_t*)malloc(num_blocks*sizeof(uint32_t));
+	if(!wl_erase_count || !wl_heap)
+	{
+		printf("Not enough memory for the erase counts\n");
+		return false;
+	}
+	wl_max_count = 0;
+	wl_heap_size = 0;
+	return true;
+}
+
+void wl_counts_loaded()
+{
+	wl_max_count = 0;
+	for(uint32_t block=0;block<wl_num_blocks;block++)
+	{
+		if(wl_erase_count[block]>wl_max_count)
+		{
+			wl_max_count = wl_erase_count[block];
+		}
+	}
+}
+
+uint32_t wl_free_blocks()
+{
+	return wl_heap_size;
+}
+
+void wl_clear_free()
+{
+	wl_heap_size = 0;
+}
+
+FORCE_INLINE inline bool wl_less(uint32_t a, uint32_t b)
+{
+	return wl_erase_count[wl_heap[a]]<wl_erase_count[wl_heap[b]];
+}
+
+FORCE_INLINE inline void wl_swap(uint32_t a, uint32_t b)
+{
+	uint32_t block = wl_heap[a];
+	wl_heap[a] = wl_heap[b];
+	wl_heap[b] = block;
+}
+
+void wl_release(uint32_t block)
+{
+	uint32_t i = wl_heap_size++;
+
+	wl_heap[i] = block;
+	while(i>0 && wl_less(i,(i-1)/2))
+	{
+		wl_swap(i,(i-1)/2);
+		i = (i-1)/2;
+	}
+}
+
+uint32_t wl_allocate()
+{
+	if(wl_heap_size==0)
+	{
+		return WL_NONE;
+	}
+	uint32_t block = wl_heap[0];
+	uint32_t i = 0;
+
+	wl_heap[0] = wl_heap[--wl_heap_size];
+	while(true)
+	{
+		uint32_t smallest = i;
+		uint32_t left = 2*i+1;
+		uint32_t right = 2*i+2;
+
+		if(left<wl_heap_size && wl_less(left,smallest))
+		{
+			smallest = left;
+		}
+		if(right<wl_heap_size && wl_less(right,smallest))
+		{
+			smallest = right;
+		}
+		if(smallest==i)
+		{
+			break;
+		}
+		wl_swap(i,smallest);
+		i = smallest;
+	}
+	return block;
+}
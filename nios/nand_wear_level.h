@@ -0,0 +1,76 @@
+/*
+File: nand_wear_level.h
+Description: Erase counts and wear-leveling block allocation
+			.. one 16-bit erase count per block, saturating
+			.. free blocks wait in a min-heap on their erase count, so the least worn one is opened next
+			.. .. this only spreads the erases over the blocks that become free (dynamic wear leveling)
+			.. blocks holding cold data never become free, so once the coldest one is WL_STATIC_THRESHOLD
+			.. .. erases behind the most worn one its data is moved out and the block goes back to the heap
+			.. .. (static wear leveling, the FTL moves at most WL_PAGE_BUDGET pages per host write)
+			.. Each of the functions declared here are defined in file nand_wear_level.c
+*/
+#ifndef nand_wear_level_h
+#define nand_wear_level_h
+
+#include "nand_interface_header.h"
+
+// block that is not there
+#define WL_NONE 0xffffffff
+
+// spread of erase counts that starts static wear leveling
+#ifndef WL_STATIC_THRESHOLD
+	#define WL_STATIC_THRESHOLD 100
+#endif
+
+// pages of cold data moved per host write, bounds the extra latency static wear leveling adds to a write
+#ifndef WL_PAGE_BUDGET
+	#define WL_PAGE_BUDGET 1
+#endif
+
+// allocated in whole pages so it can be written and read straight from here
+extern uint16_t* wl_erase_count;
+extern uint32_t wl_num_blocks;
+// highest erase count of any block
+extern uint16_t wl_max_count;
+
+// function to set up the counts (all 0) and an empty heap for num_blocks blocks
+bool wl_init(uint32_t num_blocks);
+
+// pages the erase counts take
+uint32_t wl_count_pages();
+
+// function to recompute wl_max_count after the counts were read back
+void wl_counts_loaded();
+
+// function to count one erase of a block
+FORCE_INLINE inline void wl_erased(uint32_t block)
+{
+	if(wl_erase_count[block]<0xffff)
+	{
+		wl_erase_count[block]++;
+	}
+	if(wl_erase_count[block]>wl_max_count)
+	{
+		wl_max_count = wl_erase_count[block];
+	}
+}
+
+// true when a block is far enough behind the most worn one for its data to be moved
+FORCE_INLINE inline bool wl_is_cold(uint32_t block)
+{
+	return wl_max_count-wl_erase_count[block]>WL_STATIC_THRESHOLD;
+}
+
+// number of blocks in the heap
+uint32_t wl_free_blocks();
+
+// function to empty the heap
+void wl_clear_free();
+
+// function to put a free block in the heap
+void wl_release(uint32_t block);
+
+// function to take the free block with the lowest erase count, WL_NONE if there is none
+uint32_t wl_allocate();
+
+#endif